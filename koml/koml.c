@@ -2,83 +2,284 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#ifdef __linux__
+#include <sys/random.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <libgen.h>
+#endif
+#if defined(__linux__) && !defined(KOML_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define KOML_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+/* most dimensions an aa..i/aa..f array may have */
+#define KOML_MAX_RANK 8
+/* reads kept in flight by koml_load_many */
+#define KOML_READ_DEPTH 32
+/* quiet period koml_watch waits for after the last change before reloading */
+#define KOML_WATCH_DEBOUNCE_MS 50
+/* shared images are stored for addresses in 4 GiB slots from here up, a range mmap does not hand out on its own */
+#define KOML_SHARED_BASE 0x200000000000ULL
+#define KOML_SHARED_SLOTS 4096
+#define KOML_SHARED_SLOT_SIZE (1ULL << 32)
+
+/* older headers and other systems: the address becomes a hint, and a mapping elsewhere is rebased instead */
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0
+#endif
+
+enum {
+	KOML_TABLE_OWNS_SOURCE = 1 << 0,
+	/* heap table freed by the koml_table_destroy that drops its last reference */
+	KOML_TABLE_OWNS_SELF = 1 << 1,
+	/* lazy values are checked for utf-8 when decoded */
+	KOML_TABLE_UTF8 = 1 << 2,
+};
 
-static unsigned long long int koml_internal_hash(char * start, unsigned long long int length) {
-	unsigned long long int hash = 5381;
+static koml_symbol_t * koml_internal_symbol_at(koml_table_t * table, unsigned long long int index);
+static koml_symbol_t * koml_internal_lookup(koml_table_t * table, char * name, unsigned long long int name_length, unsigned long long int seed, unsigned long long int hash, unsigned char sample, int * out_error);
+static int koml_internal_load_cached(koml_table_t * out_table, char * buffer, unsigned long long int buffer_length, koml_load_options_t * options);
 
-	for (unsigned long long int i = 0; i < length; ++i) {
-		hash = (hash << 5) + hash + start[i];
-	}
+static unsigned long long int koml_wymix(unsigned long long int a, unsigned long long int b) {
+	__uint128_t product = (__uint128_t) a * b;
+	return (unsigned long long int) product ^ (unsigned long long int) (product >> 64);
+}
 
-	return hash;
+static unsigned long long int koml_wyread8(unsigned char * p) {
+	unsigned long long int value;
+	memcpy(&value, p, sizeof(value));
+	return value;
 }
 
-static int koml_table_alloc_new(koml_table_t * table) {
-	++table->length;
-	if (table->hashes == NULL) {
-		table->hashes = malloc(table->length * sizeof(unsigned long long int));
+static unsigned long long int koml_wyread4(unsigned char * p) {
+	unsigned int value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static unsigned long long int koml_wysecret[] = { 0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL };
+
+/* wyhash: 8 bytes at a time through 64x64->128 multiplies. keys up to 16 bytes take two overlapping reads */
+unsigned long long int koml_hash(char * name, unsigned long long int length, unsigned long long int seed) {
+	unsigned char * p = (unsigned char *) name;
+	unsigned long long int * secret = koml_wysecret;
+	unsigned long long int a = 0;
+	unsigned long long int b = 0;
+
+	seed ^= koml_wymix(seed ^ secret[0], secret[1]);
+	if (length <= 16) {
+		if (length >= 4) {
+			unsigned long long int shift = (length >> 3) << 2;
+			a = (koml_wyread4(p) << 32) | koml_wyread4(p + shift);
+			b = (koml_wyread4(p + length - 4) << 32) | koml_wyread4(p + length - 4 - shift);
+		} else if (length > 0) {
+			a = ((unsigned long long int) p[0] << 16) | ((unsigned long long int) p[length >> 1] << 8) | p[length - 1];
+		}
 	} else {
-		table->hashes = realloc(table->hashes, table->length * sizeof(unsigned long long int));
+		unsigned long long int i = length;
+		if (i > 48) {
+			unsigned long long int see1 = seed;
+			unsigned long long int see2 = seed;
+			do {
+				seed = koml_wymix(koml_wyread8(p) ^ secret[1], koml_wyread8(p + 8) ^ seed);
+				see1 = koml_wymix(koml_wyread8(p + 16) ^ secret[2], koml_wyread8(p + 24) ^ see1);
+				see2 = koml_wymix(koml_wyread8(p + 32) ^ secret[3], koml_wyread8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+
+		while (i > 16) {
+			seed = koml_wymix(koml_wyread8(p) ^ secret[1], koml_wyread8(p + 8) ^ seed);
+			p += 16;
+			i -= 16;
+		}
+
+		a = koml_wyread8(p + i - 16);
+		b = koml_wyread8(p + i - 8);
 	}
 
-	if (table->hashes == NULL) {
-		return 1;
+	__uint128_t product = (__uint128_t) (a ^ secret[1]) * (b ^ seed);
+	a = (unsigned long long int) product;
+	b = (unsigned long long int) (product >> 64);
+	return koml_wymix(a ^ secret[0] ^ length, b ^ secret[1]);
+}
+
+static unsigned long long int koml_process_secret = 0;
+static unsigned long long int koml_seed_counter = 0;
+static pthread_once_t koml_process_secret_once = PTHREAD_ONCE_INIT;
+/* table generations are process-wide, so a handle never matches a table it was not resolved against; 0 is never handed out */
+static unsigned long long int koml_generation_counter = 0;
+
+static void koml_internal_secret_init(void) {
+	unsigned long long int secret = 0;
+
+#ifdef __linux__
+	if (getrandom(&secret, sizeof(secret), GRND_NONBLOCK) == sizeof(secret)) {
+		koml_process_secret = secret;
+		return;
 	}
+#endif
 
-	if (table->symbols == NULL) {
-		table->symbols = malloc(table->length * sizeof(koml_symbol_t));
-	} else {
-		table->symbols = realloc(table->symbols, table->length * sizeof(koml_symbol_t));
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	secret = ((unsigned long long int) now.tv_sec << 32) ^ now.tv_nsec ^ ((unsigned long long int) getpid() << 16) ^ (unsigned long long int) &secret;
+	koml_process_secret = koml_wymix(secret ^ koml_wysecret[2], koml_wysecret[3]);
+}
+
+/* distinct for every table and not predictable from outside the process, so tenants cannot pick colliding key names */
+static unsigned long long int koml_internal_random_seed(void) {
+	pthread_once(&koml_process_secret_once, koml_internal_secret_init);
+
+	unsigned long long int count = __atomic_add_fetch(&koml_seed_counter, 1, __ATOMIC_RELAXED);
+	return koml_hash((char *) &count, sizeof(count), koml_process_secret);
+}
+
+static void koml_internal_table_init(koml_table_t * table) {
+	table->length = 0;
+	table->hashes = NULL;
+	table->symbols = NULL;
+	table->source = NULL;
+	table->lazy = NULL;
+	table->base = NULL;
+	table->refcount = 1;
+	table->index = NULL;
+	table->index_mask = 0;
+	table->flags = 0;
+	table->block = NULL;
+	table->block_size = 0;
+	table->seed = koml_internal_random_seed();
+	table->telemetry = NULL;
+	table->generation = __atomic_add_fetch(&koml_generation_counter, 1, __ATOMIC_RELAXED);
+}
+
+static unsigned char koml_internal_name_equal(char * name, char * word, unsigned long long int word_length) {
+	return strncmp(name, word, word_length) == 0 && name[word_length] == '\0';
+}
+
+/* open addressing over symbol slots; index[i] holds slot + 1, 0 marks an empty entry */
+static long long int koml_internal_find(koml_table_t * table, char * name, unsigned long long int name_length, unsigned long long int hash) {
+	if (table->index == NULL) {
+		for (unsigned long long int i = 0; i < table->length; ++i) {
+			if (table->hashes[i] == hash && koml_internal_name_equal(table->symbols[i].name, name, name_length)) {
+				return i;
+			}
+		}
+
+		return -1;
 	}
 
-	if (table->symbols == NULL) {
-		return 2;
+	for (unsigned long long int i = hash & table->index_mask; table->index[i] != 0; i = (i + 1) & table->index_mask) {
+		unsigned long long int slot = table->index[i] - 1;
+		if (table->hashes[slot] == hash && koml_internal_name_equal(table->symbols[slot].name, name, name_length)) {
+			return slot;
+		}
 	}
 
-	memset(&table->symbols[table->length - 1].data, 0, sizeof(table->symbols[table->length - 1].data));
+	return -1;
+}
+
+/* whether a lookup through table reaches slot i of layer (table or one of its bases): overlays shadow their base, first duplicate wins */
+static unsigned char koml_internal_reachable(koml_table_t * table, koml_table_t * layer, unsigned long long int i) {
+	char * name = layer->symbols[i].name;
+	unsigned long long int name_length = strlen(name);
+	for (; table != NULL; table = table->base) {
+		long long int slot = koml_internal_find(table, name, name_length, layer->hashes[i]);
+		if (slot >= 0) {
+			return table == layer && (unsigned long long int) slot == i;
+		}
+	}
 
 	return 0;
 }
 
-static int koml_array_alloc_new(koml_array_t * array) {
-	++array->length;
-	if (array->strides == NULL) {
-		array->strides = malloc(array->length * sizeof(unsigned long long int));
-	} else {
-		array->strides = realloc(array->strides, array->length * sizeof(unsigned long long int));
+static unsigned long long int koml_internal_index_capacity(unsigned long long int length) {
+	unsigned long long int capacity = 8;
+	while (capacity < length * 2) {
+		capacity <<= 1;
 	}
 
-	if (array->strides == NULL) {
+	return capacity;
+}
+
+static void koml_internal_index_fill(koml_table_t * table, unsigned long long int * index, unsigned long long int capacity) {
+	for (unsigned long long int slot = 0; slot < table->length; ++slot) {
+		unsigned long long int i = table->hashes[slot] & (capacity - 1);
+		unsigned char duplicate = 0;
+		for (; index[i] != 0; i = (i + 1) & (capacity - 1)) {
+			unsigned long long int other = index[i] - 1;
+			if (table->hashes[other] == table->hashes[slot] && strcmp(table->symbols[other].name, table->symbols[slot].name) == 0) {
+				duplicate = 1;
+				break;
+			}
+		}
+
+		if (!duplicate) {
+			index[i] = slot + 1;
+		}
+	}
+}
+
+static int koml_internal_index_build(koml_table_t * table) {
+	unsigned long long int capacity = koml_internal_index_capacity(table->length);
+
+	free(table->index);
+	table->index = NULL;
+
+	unsigned long long int * index = calloc(capacity, sizeof(unsigned long long int));
+	if (index == NULL) {
 		return 1;
 	}
 
-	unsigned long long int stride = 0;
-	switch (array->type) {
-		case KOML_TYPE_INT:
-		case KOML_TYPE_FLOAT:
-			stride = 4;
-			break;
-		case KOML_TYPE_STRING:
-			stride = sizeof(char *);
-			break;
-		case KOML_TYPE_BOOLEAN:
-			stride = 1;
-			break;
-		default:
-			return 3;
+	koml_internal_index_fill(table, index, capacity);
+	table->index = index;
+	table->index_mask = capacity - 1;
+	return 0;
+}
+
+static int koml_table_alloc_new(koml_table_t * table) {
+	++table->length;
+	if (table->hashes == NULL) {
+		table->hashes = malloc(table->length * sizeof(unsigned long long int));
+	} else {
+		table->hashes = realloc(table->hashes, table->length * sizeof(unsigned long long int));
 	}
 
-	if (array->elements.voidptr == NULL) {
-		array->elements.voidptr = malloc(array->length * stride);
+	if (table->hashes == NULL) {
+		return 1;
+	}
+
+	if (table->symbols == NULL) {
+		table->symbols = malloc(table->length * sizeof(koml_symbol_t));
 	} else {
-		array->elements.voidptr = realloc(array->elements.voidptr, array->length * stride);
+		table->symbols = realloc(table->symbols, table->length * sizeof(koml_symbol_t));
 	}
 
-	if (array->elements.voidptr == NULL) {
+	if (table->symbols == NULL) {
 		return 2;
 	}
 
+	memset(&table->symbols[table->length - 1], 0, sizeof(koml_symbol_t));
+
 	return 0;
 }
 
@@ -123,22 +324,25 @@ static int koml_array_alloc_new_amount(koml_array_t * array, unsigned long long
 	return 0;
 }
 
-static char is_whitespace(char c) {
-	if (c == '\t' || c == '\r' || c == '\n' || c == ' ') {
-		return 1;
-	}
-
-	return 0;
+static unsigned long long int koml_internal_element_stride(koml_type_enum type) {
+	return (type == KOML_TYPE_STRING) ? sizeof(char *) : (type == KOML_TYPE_BOOLEAN) ? 1 : 4;
 }
 
 static int wtoi(char * start, unsigned long long int length, unsigned int radix) {
 	int ret = 0;
+	int sign = 1;
+	unsigned long long int i = 0;
 
-	for (unsigned long long int i = 0; i < length; ++i) {
+	if (length > 0 && start[0] == '-') {
+		sign = -1;
+		i = 1;
+	}
+
+	for (; i < length; ++i) {
 		ret = ret * radix + (start[i] - '0');
 	}
 
-	return ret;
+	return ret * sign;
 }
 
 static float wtof(char * start, unsigned long long int length) {
@@ -169,7 +373,7 @@ static unsigned char is_boolean(char * start, unsigned long long int length) {
 }
 
 static unsigned char is_num(char c) {
-	return ((isalnum(c) && !isalpha(c)) || c == '-');
+	return (c >= '0' && c <= '9') || c == '-';
 }
 
 static unsigned char wtotf(char * start, unsigned long long int length) {
@@ -228,9 +432,30 @@ static char * koml_type_strings[] = {
 	"array",
 };
 
+/* rows of a shaped array that open before element i, or close after element i - 1 */
+static unsigned int koml_internal_row_edges(koml_array_t * array, unsigned long long int i) {
+	unsigned int edges = 0;
+	unsigned long long int extent = 1;
+
+	if (array->shape == NULL) {
+		return 0;
+	}
+
+	for (unsigned int k = array->rank - 1; k > 0; --k) {
+		extent *= array->shape[k];
+		edges += (i % extent == 0);
+	}
+
+	return edges;
+}
+
 void koml_array_print(koml_array_t * array) {
 	printf("(%s) [ ", koml_type_strings[array->type]);
 	for (unsigned long long int i = 0; i < array->length; ++i) {
+		for (unsigned int n = koml_internal_row_edges(array, i); n > 0; --n) {
+			printf("[ ");
+		}
+
 		switch (array->type) {
 			case KOML_TYPE_INT:
 				printf("%i", array->elements.i32[i]);
@@ -250,6 +475,10 @@ void koml_array_print(koml_array_t * array) {
 				break;
 		}
 
+		for (unsigned int n = koml_internal_row_edges(array, i + 1); n > 0; --n) {
+			printf(" ]");
+		}
+
 		if (i < array->length - 1) {
 			printf(", ");
 		}
@@ -285,1314 +514,5154 @@ void koml_symbol_print(koml_symbol_t * symbol) {
 void koml_table_print(koml_table_t * table) {
 	puts("{");
 	for (unsigned long long int i = 0; i < table->length; ++i) {
+		koml_symbol_t * symbol = koml_internal_symbol_at(table, i);
 		putc(' ', stdout);
 		putc(' ', stdout);
-		koml_symbol_print(&table->symbols[i]);
+		if (symbol != NULL) {
+			koml_symbol_print(symbol);
+		} else {
+			printf("%s (%s): ???", table->symbols[i].name, koml_type_strings[table->symbols[i].type]);
+		}
 		putc('\n', stdout);
 	}
 	puts("}");
 }
 
-typedef enum KOMLParserStateEnum {
-	KOML_PARSER_STATE_NONE = 0,
-	KOML_PARSER_STATE_SECTION_WAIT,
-	KOML_PARSER_STATE_SECTION_NAME,
-	KOML_PARSER_STATE_INTEGER_WAIT,
-	KOML_PARSER_STATE_INTEGER_NAME,
-	KOML_PARSER_STATE_INTEGER_VALUE,
-	KOML_PARSER_STATE_FLOAT_WAIT,
-	KOML_PARSER_STATE_FLOAT_NAME,
-	KOML_PARSER_STATE_FLOAT_VALUE,
-	KOML_PARSER_STATE_STRING_WAIT,
-	KOML_PARSER_STATE_STRING_NAME,
-	KOML_PARSER_STATE_STRING_VALUE,
-	KOML_PARSER_STATE_BOOLEAN_WAIT,
-	KOML_PARSER_STATE_BOOLEAN_NAME,
-	KOML_PARSER_STATE_BOOLEAN_VALUE,
-	KOML_PARSER_STATE_ARRAY_TYPE_WAIT,
-	KOML_PARSER_STATE_ARRAY_WAIT,
-	KOML_PARSER_STATE_ARRAY_NAME,
-	KOML_PARSER_STATE_ARRAY_VALUE,
-} koml_parser_state_enum;
-
-int koml_table_load(koml_table_t * out_table, char * buffer, unsigned long long int buffer_length) {
-	if (buffer == NULL || buffer_length == 0) {
-		return 1;
+static int koml_sink_flush(koml_sink_t * sink) {
+	if (sink->callback == NULL || sink->length == 0) {
+		return 0;
 	}
 
-	out_table->length = 0;
-	out_table->hashes = NULL;
-	out_table->symbols = NULL;
-
-	struct {
-		char * start;
-		unsigned long long int length;
-		unsigned long long int hash;
-	} word = {
-		.start = NULL,
-		.length = 0,
-		.hash = 0,
-	};
-
-	struct {
-		char * start;
-		unsigned long long int length;
-	} section = {
-		.start = NULL,
-		.length = 0,
-	};
-
-	char c = 127;
-	char prevc = 127;
-
-	koml_parser_state_enum state = KOML_PARSER_STATE_NONE;
-	unsigned long long int line = 0;
-	unsigned long long int column = 0;
+	if (sink->callback(sink->user, sink->buffer, sink->length) != 0) {
+		return 3;
+	}
 
-	for (unsigned long long int i = 0; i < buffer_length; ++i) {
-		prevc = c;
-		c = buffer[i];
-		++column;
+	sink->length = 0;
+	return 0;
+}
 
-		if (c == '|') {
-			++i;
-			c = buffer[i];
-			while (c != '|') {
-				++i;
-				if (i >= buffer_length) {
-					printf("Comment never ended (line %llu: column %llu)\n  | ", line + 1, column + 1);
-					koml_printline(buffer, line, column);
-					printf("\n  | ");
-					koml_printcursor(column);
-					printf("\n");
-					return 6;
-				}
-				c = buffer[i];
+static int koml_sink_put(koml_sink_t * sink, char * data, unsigned long long int length) {
+	if (sink->callback == NULL) {
+		if (sink->buffer != NULL) {
+			if (sink->length + length > sink->capacity) {
+				return 2;
 			}
+			memcpy(&sink->buffer[sink->length], data, length);
+		}
+		sink->length += length;
+		return 0;
+	}
 
-			++i;
-			c = buffer[i];
+	if (sink->length + length > sink->capacity) {
+		if (koml_sink_flush(sink) != 0) {
+			return 3;
 		}
 
-		if (c == '\n') {
-			++line;
-			column = 0;
+		if (length > sink->capacity) {
+			return (sink->callback(sink->user, data, length) != 0) ? 3 : 0;
 		}
+	}
 
-		switch (state) {
-			case KOML_PARSER_STATE_SECTION_WAIT:
-				word.start = &buffer[i];
-				word.length = 0;
-				state = KOML_PARSER_STATE_SECTION_NAME;
-				continue;
-			case KOML_PARSER_STATE_SECTION_NAME:
-				++word.length;
-				if (c == ']') {
-					state = KOML_PARSER_STATE_NONE;
-					section.start = word.start;
-					section.length = word.length;
-				} else if ((isalnum(c) || ispunct(c)) && word.start != NULL && is_whitespace(prevc)) {
-					printf("Invalid section name (line %llu: column %llu)\n  | ", line + 1, column);
-					koml_printline(buffer, line, column);
-					printf("\n  | ");
-					koml_printcursor(column - 1);
-					printf("\n");
-					return 14;
-				}
-				continue;
-			case KOML_PARSER_STATE_INTEGER_WAIT:
-				if (is_whitespace(c)) {
-					continue;
-				}
+	memcpy(&sink->buffer[sink->length], data, length);
+	sink->length += length;
+	return 0;
+}
 
-				word.start = &buffer[i];
-				word.length = 0;
-				state = KOML_PARSER_STATE_INTEGER_NAME;
-				continue;
-			case KOML_PARSER_STATE_INTEGER_NAME:
-				if (is_whitespace(c)) {
-					continue;
-				}
+static char koml_digit_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static unsigned long long int koml_internal_utoa(unsigned long long int value, char * out) {
+	char tmp[20];
+	char * p = &tmp[20];
+
+	while (value >= 100) {
+		p -= 2;
+		memcpy(p, &koml_digit_pairs[(value % 100) * 2], 2);
+		value /= 100;
+	}
 
-				++word.length;
-				if (c == '=') {
-					out_table->symbols[out_table->length - 1].name = NULL;
-					unsigned long long int tmp_length = 0;
-					if (section.start != NULL) {
-						tmp_length = word.length + section.length + 1;
-						out_table->symbols[out_table->length - 1].name = malloc(tmp_length + 1);
-						if (out_table->symbols[out_table->length - 1].name == NULL || word.start == NULL || section.start == NULL) {
-							printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 1;
-						}
-
-						out_table->symbols[out_table->length - 1].name[tmp_length] = '\0';
-
-						memcpy(out_table->symbols[out_table->length - 1].name, section.start, section.length);
-						out_table->symbols[out_table->length - 1].name[section.length] = ':';
-						memcpy(&out_table->symbols[out_table->length - 1].name[section.length + 1], word.start, word.length);
-					} else {
-						tmp_length = word.length;
-						out_table->symbols[out_table->length - 1].name = malloc(tmp_length + 1);
-						if (out_table->symbols[out_table->length - 1].name == NULL || word.start == NULL) {
-							printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 1;
-						}
-						out_table->symbols[out_table->length - 1].name[tmp_length] = '\0';
-						memcpy(out_table->symbols[out_table->length - 1].name, word.start, tmp_length);
-					}
-					if (out_table->symbols[out_table->length - 1].name == NULL) {
-						printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 1;
-					}
+	if (value >= 10) {
+		p -= 2;
+		memcpy(p, &koml_digit_pairs[value * 2], 2);
+	} else {
+		*(--p) = (char) ('0' + value);
+	}
 
-					out_table->hashes[out_table->length - 1] = koml_internal_hash(out_table->symbols[out_table->length - 1].name, tmp_length);
-
-					word.start = NULL;
-					word.length = 0;
-					word.hash = 0;
-					state = KOML_PARSER_STATE_INTEGER_VALUE;
-				} else if ((isalnum(c) || ispunct(c)) && word.start != NULL && is_whitespace(prevc)) {
-					printf("Invalid variable name (line %llu: column %llu)\n  | ", line + 1, column);
-					koml_printline(buffer, line, column);
-					printf("\n  | ");
-					koml_printcursor(column - 1);
-					printf("\n");
-					return 13;
-				}
+	memcpy(out, p, &tmp[20] - p);
+	return &tmp[20] - p;
+}
 
-				continue;
-			case KOML_PARSER_STATE_INTEGER_VALUE:
-				if (is_whitespace(c)) {
-					continue;
-				}
+static unsigned long long int koml_internal_itoa(int value, char * out) {
+	if (value < 0) {
+		out[0] = '-';
+		return 1 + koml_internal_utoa(-(long long int) value, &out[1]);
+	}
 
-				if (c == '@') {
-					koml_symbol_t * ptr;
-					++i;
-					c = buffer[i];
-					word.start = &buffer[i];
-					word.length = 0;
-					while (c != ';') {
-						++i;
-						++word.length;
-						if (i >= buffer_length) {
-							printf("Variable reference never ended (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 16;
-						}
-						c = buffer[i];
-					}
-					ptr = koml_table_symbol_word(out_table, word.start, word.length);
-					if (ptr == NULL) {
-						printf("Variable reference to undefined symbol (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 17;
-					}
+	return koml_internal_utoa(value, out);
+}
 
-					if (ptr->type != KOML_TYPE_INT && ptr->type != KOML_TYPE_FLOAT) {
-						printf("Invalid type of variable reference (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 18;
-					}
+static double koml_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+	1e21, 1e22,
+};
 
-					if (ptr->type == KOML_TYPE_FLOAT) {
-						out_table->symbols[out_table->length - 1].data.i32 = (int) ptr->data.f32;
-					} else {
-						out_table->symbols[out_table->length - 1].data.i32 = ptr->data.i32;
-					}
+/* lays out significant digits positionally, since the parser has no exponent syntax */
+static unsigned long long int koml_internal_fdigits(char * out, char * digits, long long int count, long long int point) {
+	char * p = out;
 
-					word.start = NULL;
-					word.length = 0;
-					word.hash = 0;
-					state = KOML_PARSER_STATE_NONE;
-					continue;
-				}
+	while (count > 1 && digits[count - 1] == '0') {
+		--count;
+	}
 
-				if (c == ';') {
-					int value = wtoi(word.start, word.length, 10);
-					out_table->symbols[out_table->length - 1].data.i32 = value;
+	if (point <= 0) {
+		*(p++) = '0';
+		*(p++) = '.';
+		memset(p, '0', -point);
+		p += -point;
+		memcpy(p, digits, count);
+		p += count;
+	} else if (point >= count) {
+		memcpy(p, digits, count);
+		p += count;
+		memset(p, '0', point - count);
+		p += point - count;
+	} else {
+		memcpy(p, digits, point);
+		p += point;
+		*(p++) = '.';
+		memcpy(p, &digits[point], count - point);
+		p += count - point;
+	}
 
-					word.start = NULL;
-					word.length = 0;
-					word.hash = 0;
-					state = KOML_PARSER_STATE_NONE;
-					continue;
-				}
+	return p - out;
+}
 
-				if (!is_num(c)) {
-					if (c == '"') {
-						printf("A string literal is not a valid integer value (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 8;
-					}
-					printf("Invalid integer value (line %llu: column %llu)\n  | ", line + 1, column + 1);
-					koml_printline(buffer, line, column);
-					printf("\n  | ");
-					koml_printcursor(column);
-					printf("\n");
-					return 8;
-				}
+/* shortest decimal that reads back bit-identical through wtof, or 0 for nan/inf */
+static unsigned long long int koml_internal_ftoa(float value, char * out) {
+	char * p = out;
+	char digits[32];
 
-				if (word.start == NULL) {
-					word.start = &buffer[i];
-					word.length = 0;
-				}
-				++word.length;
-				continue;
-			case KOML_PARSER_STATE_FLOAT_WAIT:
-				if (is_whitespace(c)) {
-					continue;
-				}
+	if (value != value || value - value != 0) {
+		return 0;
+	}
 
-				word.start = &buffer[i];
-				word.length = 0;
-				state = KOML_PARSER_STATE_FLOAT_NAME;
-				continue;
-			case KOML_PARSER_STATE_FLOAT_NAME:
-				if (is_whitespace(c)) {
-					continue;
-				}
+	if (signbit(value)) {
+		*(p++) = '-';
+		value = -value;
+	}
 
-				++word.length;
-				if (c == '=') {
-					out_table->symbols[out_table->length - 1].name = NULL;
-					unsigned long long int tmp_length = 0;
-					if (section.start != NULL) {
-						tmp_length = word.length + section.length + 1;
-						out_table->symbols[out_table->length - 1].name = malloc(tmp_length + 1);
-						if (out_table->symbols[out_table->length - 1].name == NULL || word.start == NULL || section.start == NULL) {
-							printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 1;
-						}
-
-						out_table->symbols[out_table->length - 1].name[tmp_length] = '\0';
-
-						memcpy(out_table->symbols[out_table->length - 1].name, section.start, section.length);
-						out_table->symbols[out_table->length - 1].name[section.length] = ':';
-						memcpy(&out_table->symbols[out_table->length - 1].name[section.length + 1], word.start, word.length);
-					} else {
-						tmp_length = word.length;
-						out_table->symbols[out_table->length - 1].name = malloc(tmp_length + 1);
-						if (out_table->symbols[out_table->length - 1].name == NULL || word.start == NULL) {
-							printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 1;
-						}
-						out_table->symbols[out_table->length - 1].name[tmp_length] = '\0';
-						memcpy(out_table->symbols[out_table->length - 1].name, word.start, tmp_length);
-					}
-					if (out_table->symbols[out_table->length - 1].name == NULL) {
-						printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 1;
-					}
+	if (value == 0) {
+		*(p++) = '0';
+		return p - out;
+	}
 
-					out_table->hashes[out_table->length - 1] = koml_internal_hash(out_table->symbols[out_table->length - 1].name, tmp_length);
-
-					word.start = NULL;
-					word.length = 0;
-					word.hash = 0;
-					state = KOML_PARSER_STATE_FLOAT_VALUE;
-				} else if ((isalnum(c) || ispunct(c)) && word.start != NULL && is_whitespace(prevc)) {
-					printf("Invalid section name (line %llu: column %llu)\n  | ", line + 1, column);
-					koml_printline(buffer, line, column);
-					printf("\n  | ");
-					koml_printcursor(column - 1);
-					printf("\n");
-					return 14;
-				}
+	double v = value;
+	if (v >= 1e-13 && v < 1e22) {
+		long long int k = 0;
+		if (v >= 1) {
+			while (k < 22 && koml_pow10[k + 1] <= v) {
+				++k;
+			}
+		} else {
+			while (koml_pow10[-k] * v < 1) {
+				--k;
+			}
+		}
 
-				continue;
-			case KOML_PARSER_STATE_FLOAT_VALUE:
-				if (is_whitespace(c)) {
-					continue;
-				}
+		for (long long int precision = 1; precision <= 9; ++precision) {
+			long long int scale = precision - 1 - k;
+			double scaled = (scale >= 0) ? v * koml_pow10[scale] : v / koml_pow10[-scale];
+			unsigned long long int mantissa = (unsigned long long int) (scaled + 0.5);
+			long long int point = k + 1;
+			if (mantissa >= (unsigned long long int) koml_pow10[precision]) {
+				mantissa /= 10;
+				--scale;
+				++point;
+			}
 
-				if (c == '@') {
-					koml_symbol_t * ptr;
-					++i;
-					c = buffer[i];
-					word.start = &buffer[i];
-					word.length = 0;
-					while (c != ';') {
-						++i;
-						++word.length;
-						if (i >= buffer_length) {
-							printf("Variable reference never ended (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 16;
-						}
-						c = buffer[i];
-					}
-					ptr = koml_table_symbol_word(out_table, word.start, word.length);
-					if (ptr == NULL) {
-						printf("Variable reference to undefined symbol (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 17;
-					}
+			double back = (scale >= 0) ? (double) mantissa / koml_pow10[scale] : (double) mantissa * koml_pow10[-scale];
+			if ((float) back == value) {
+				long long int count = koml_internal_utoa(mantissa, digits);
+				return (p - out) + koml_internal_fdigits(p, digits, count, point);
+			}
+		}
+	}
 
-					if (ptr->type != KOML_TYPE_INT && ptr->type != KOML_TYPE_FLOAT) {
-						printf("Invalid type of variable reference (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 18;
-					}
+	for (int precision = 1; precision <= 9; ++precision) {
+		char tmp[32];
+		snprintf(tmp, sizeof(tmp), "%.*e", precision - 1, v);
+		if ((float) strtod(tmp, NULL) != value) {
+			continue;
+		}
 
-					if (ptr->type == KOML_TYPE_FLOAT) {
-						out_table->symbols[out_table->length - 1].data.f32 = ptr->data.f32;
-					} else {
-						out_table->symbols[out_table->length - 1].data.f32 =  (float) ptr->data.i32;
-					}
+		long long int count = 0;
+		char * e = tmp;
+		for (; *e != 'e'; ++e) {
+			if (*e != '.') {
+				digits[count++] = *e;
+			}
+		}
 
-					word.start = NULL;
-					word.length = 0;
-					word.hash = 0;
-					state = KOML_PARSER_STATE_NONE;
-					continue;
-				}
+		return (p - out) + koml_internal_fdigits(p, digits, count, strtol(e + 1, NULL, 10) + 1);
+	}
 
-				if (c == ';') {
-					float value = wtof(word.start, word.length);
-					out_table->symbols[out_table->length - 1].data.f32 = value;
+	return 0;
+}
 
-					word.start = NULL;
-					word.length = 0;
-					word.hash = 0;
-					state = KOML_PARSER_STATE_NONE;
-					continue;
-				}
+typedef struct koml_write_entry {
+	char * name;
+	unsigned long long int section_length;
+	/* position in the walk over the layers, which keeps the sort stable */
+	unsigned long long int index;
+	koml_table_t * layer;
+	unsigned long long int slot;
+} koml_write_entry_t;
+
+/* '.' sorts below every other byte so that [a.b] directly follows [a] */
+static int koml_internal_section_compare(const void * a, const void * b) {
+	const koml_write_entry_t * ea = a;
+	const koml_write_entry_t * eb = b;
+
+	unsigned long long int length = (ea->section_length < eb->section_length) ? ea->section_length : eb->section_length;
+	for (unsigned long long int i = 0; i < length; ++i) {
+		unsigned char ca = (ea->name[i] == '.') ? 0 : (unsigned char) ea->name[i];
+		unsigned char cb = (eb->name[i] == '.') ? 0 : (unsigned char) eb->name[i];
+		if (ca != cb) {
+			return (ca < cb) ? -1 : 1;
+		}
+	}
 
-				if (!is_num(c) && c != '.') {
-					if (c == '"') {
-						printf("A string literal is not a valid float value (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 9;
-					}
+	if (ea->section_length != eb->section_length) {
+		return (ea->section_length < eb->section_length) ? -1 : 1;
+	}
 
-					printf("Invalid float value (line %llu: column %llu)\n  | ", line + 1, column + 1);
-					koml_printline(buffer, line, column);
-					printf("\n  | ");
-					koml_printcursor(column);
-					printf("\n");
-					return 9;
-				}
+	return (ea->index < eb->index) ? -1 : (ea->index > eb->index);
+}
 
-				if (word.start == NULL) {
-					word.start = &buffer[i];
-					word.length = 0;
-				}
-				++word.length;
-				continue;
-			case KOML_PARSER_STATE_STRING_WAIT:
-				if (is_whitespace(c)) {
-					continue;
-				}
+/* every symbol a lookup through table reaches, base layers of an overlay included, sorted by section */
+static koml_write_entry_t * koml_internal_sorted_entries(koml_table_t * table, unsigned long long int * out_count) {
+	unsigned long long int capacity = 0;
+	for (koml_table_t * layer = table; layer != NULL; layer = layer->base) {
+		capacity += layer->length;
+	}
+
+	koml_write_entry_t * entries = malloc((capacity + 1) * sizeof(koml_write_entry_t));
+	if (entries == NULL) {
+		return NULL;
+	}
 
-				word.start = &buffer[i];
-				word.length = 0;
-				state = KOML_PARSER_STATE_STRING_NAME;
+	unsigned long long int count = 0;
+	for (koml_table_t * layer = table; layer != NULL; layer = layer->base) {
+		for (unsigned long long int i = 0; i < layer->length; ++i) {
+			if (layer != table && !koml_internal_reachable(table, layer, i)) {
 				continue;
-			case KOML_PARSER_STATE_STRING_NAME:
-				if (is_whitespace(c)) {
-					continue;
-				}
+			}
 
-				++word.length;
-				if (c == '=') {
-					out_table->symbols[out_table->length - 1].name = NULL;
-					unsigned long long int tmp_length = 0;
-					if (section.start != NULL) {
-						tmp_length = word.length + section.length + 1;
-						out_table->symbols[out_table->length - 1].name = malloc(tmp_length + 1);
-						if (out_table->symbols[out_table->length - 1].name == NULL || word.start == NULL || section.start == NULL) {
-							printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 1;
-						}
-
-						out_table->symbols[out_table->length - 1].name[tmp_length] = '\0';
-
-						memcpy(out_table->symbols[out_table->length - 1].name, section.start, section.length);
-						out_table->symbols[out_table->length - 1].name[section.length] = ':';
-						memcpy(&out_table->symbols[out_table->length - 1].name[section.length + 1], word.start, word.length);
-					} else {
-						tmp_length = word.length;
-						out_table->symbols[out_table->length - 1].name = malloc(tmp_length + 1);
-						if (out_table->symbols[out_table->length - 1].name == NULL || word.start == NULL) {
-							printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 1;
-						}
-						out_table->symbols[out_table->length - 1].name[tmp_length] = '\0';
-						memcpy(out_table->symbols[out_table->length - 1].name, word.start, tmp_length);
-					}
-					if (out_table->symbols[out_table->length - 1].name == NULL) {
-						printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 1;
-					}
+			char * colon = strchr(layer->symbols[i].name, ':');
+			entries[count] = (koml_write_entry_t) {
+				.name = layer->symbols[i].name,
+				.section_length = (colon == NULL) ? 0 : (unsigned long long int) (colon - layer->symbols[i].name),
+				.index = count,
+				.layer = layer,
+				.slot = i,
+			};
+			++count;
+		}
+	}
 
-					out_table->hashes[out_table->length - 1] = koml_internal_hash(out_table->symbols[out_table->length - 1].name, tmp_length);
-
-					word.start = NULL;
-					word.length = 0;
-					word.hash = 0;
-					state = KOML_PARSER_STATE_STRING_VALUE;
-				} else if ((isalnum(c) || ispunct(c)) && word.start != NULL && is_whitespace(prevc)) {
-					printf("Invalid section name (line %llu: column %llu)\n  | ", line + 1, column);
-					koml_printline(buffer, line, column);
-					printf("\n  | ");
-					koml_printcursor(column - 1);
-					printf("\n");
-					return 14;
-				}
+	qsort(entries, count, sizeof(koml_write_entry_t), koml_internal_section_compare);
+	*out_count = count;
+	return entries;
+}
 
-				continue;
-			case KOML_PARSER_STATE_STRING_VALUE:
-				if (is_whitespace(c)) {
-					continue;
-				}
+static int koml_internal_write_scalar(koml_sink_t * sink, koml_type_enum type, void * value, char * name) {
+	char tmp[64];
+	unsigned long long int length = 0;
 
-				if (c == '"') {
-					++i;
-					c = buffer[i];
-					word.start = &buffer[i];
-					word.length = 0;
-					while (c != '"') {
-						++i;
-						++word.length;
-						if (i >= buffer_length) {
-							printf("String literal never ended (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 2;
-						}
-						c = buffer[i];
-					}
+	switch (type) {
+		case KOML_TYPE_INT:
+			length = koml_internal_itoa(*(int *) value, tmp);
+			break;
+		case KOML_TYPE_FLOAT:
+			length = koml_internal_ftoa(*(float *) value, tmp);
+			if (length == 0) {
+				printf("Float value of %s is not finite and cannot be written\n", name);
+				return 4;
+			}
+			break;
+		case KOML_TYPE_STRING: {
+			char * string = *(char **) value;
+			unsigned long long int string_length = strlen(string);
+			if (memchr(string, '"', string_length) != NULL) {
+				printf("String value of %s contains '\"' and cannot be written\n", name);
+				return 4;
+			}
+			int ret = koml_sink_put(sink, "\"", 1);
+			if (ret == 0) {
+				ret = koml_sink_put(sink, string, string_length);
+			}
+			if (ret == 0) {
+				ret = koml_sink_put(sink, "\"", 1);
+			}
+			return ret;
+		}
+		case KOML_TYPE_BOOLEAN:
+			return (*(unsigned char *) value) ? koml_sink_put(sink, "true", 4) : koml_sink_put(sink, "false", 5);
+		default:
+			printf("Value of %s has an unknown type and cannot be written\n", name);
+			return 4;
+	}
 
-					out_table->symbols[out_table->length - 1].stride = word.length;
-					out_table->symbols[out_table->length - 1].data.string = malloc(word.length + 1);
-					if (out_table->symbols[out_table->length - 1].data.string == NULL) {
-						printf("Failed to allocate string buffer (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 3;
-					}
-					out_table->symbols[out_table->length - 1].data.string[word.length] = '\0';
-					memcpy(out_table->symbols[out_table->length - 1].data.string, word.start, word.length);
-				} else if (c == ';') {
-					word.start = NULL;
-					word.length = 0;
-					word.hash = 0;
-					state = KOML_PARSER_STATE_NONE;
-					continue;
-				} else if (c == '@') {
-					koml_symbol_t * ptr;
-					++i;
-					c = buffer[i];
-					word.start = &buffer[i];
-					word.length = 0;
-					while (c != ';') {
-						++i;
-						++word.length;
-						if (i >= buffer_length) {
-							printf("Variable reference never ended (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 16;
-						}
-						c = buffer[i];
-					}
+	return koml_sink_put(sink, tmp, length);
+}
 
-					ptr = koml_table_symbol_word(out_table, word.start, word.length);
-					if (ptr == NULL) {
-						printf("Variable reference to undefined symbol (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 17;
-					}
+static char koml_type_prefixes[] = { '?', 'i', 'f', 's', 'b', 'a' };
 
-					if (ptr->type != KOML_TYPE_STRING) {
-						printf("Invalid type of variable reference (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 18;
-					}
+static int koml_internal_write_symbol(koml_sink_t * sink, koml_symbol_t * symbol, char * key, unsigned long long int depth) {
+	static char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+	char prefix[KOML_MAX_RANK + 2] = { '?', ' ', ' ' };
+	unsigned long long int prefix_length = 2;
+	int ret = 0;
 
-					out_table->symbols[out_table->length - 1].data.string = malloc(ptr->stride + 1);
-					if (out_table->symbols[out_table->length - 1].data.string == NULL) {
-						printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 1;
-					}
+	if (symbol->type == KOML_TYPE_UNKNOWN || symbol->type > KOML_TYPE_ARRAY) {
+		printf("Value of %s has an unknown type and cannot be written\n", symbol->name);
+		return 4;
+	}
+
+	prefix[0] = koml_type_prefixes[symbol->type];
+
+	if (symbol->type == KOML_TYPE_ARRAY) {
+		if (symbol->data.array.type == KOML_TYPE_UNKNOWN || symbol->data.array.type >= KOML_TYPE_ARRAY) {
+			printf("Array %s has an unknown element type and cannot be written\n", symbol->name);
+			return 4;
+		}
+		unsigned int rank = (symbol->data.array.rank > 0) ? symbol->data.array.rank : 1;
+		memset(prefix, 'a', rank);
+		prefix[rank] = koml_type_prefixes[symbol->data.array.type];
+		prefix[rank + 1] = ' ';
+		prefix_length = rank + 2;
+	}
+
+	while (ret == 0 && depth > 0) {
+		unsigned long long int amount = (depth < sizeof(tabs) - 1) ? depth : sizeof(tabs) - 1;
+		ret = koml_sink_put(sink, tabs, amount);
+		depth -= amount;
+	}
+
+	if (ret == 0) {
+		ret = koml_sink_put(sink, prefix, prefix_length);
+	}
+	if (ret == 0) {
+		ret = koml_sink_put(sink, key, strlen(key));
+	}
+	if (ret == 0) {
+		ret = koml_sink_put(sink, " = ", 3);
+	}
+	if (ret != 0) {
+		return ret;
+	}
+
+	if (symbol->type != KOML_TYPE_ARRAY) {
+		ret = koml_internal_write_scalar(sink, symbol->type, &symbol->data, symbol->name);
+	} else {
+		koml_array_t * array = &symbol->data.array;
+		unsigned long long int stride = koml_internal_element_stride(array->type);
+		for (unsigned long long int i = 0; ret == 0 && i < array->length; ++i) {
+			if (i > 0) {
+				ret = koml_sink_put(sink, ", ", 2);
+			}
+			for (unsigned int n = koml_internal_row_edges(array, i); ret == 0 && n > 0; --n) {
+				ret = koml_sink_put(sink, "[", 1);
+			}
+			if (ret == 0) {
+				ret = koml_internal_write_scalar(sink, array->type, (char *) array->elements.voidptr + i * stride, symbol->name);
+			}
+			for (unsigned int n = koml_internal_row_edges(array, i + 1); ret == 0 && n > 0; --n) {
+				ret = koml_sink_put(sink, "]", 1);
+			}
+		}
+	}
+
+	if (ret == 0) {
+		ret = koml_sink_put(sink, ";\n", 2);
+	}
+
+	return ret;
+}
+
+int koml_table_write(koml_table_t * table, koml_sink_t * sink) {
+	if (table == NULL || sink == NULL || (sink->callback != NULL && sink->buffer == NULL && sink->capacity != 0)) {
+		return 1;
+	}
+
+	unsigned long long int count = 0;
+	koml_write_entry_t * entries = koml_internal_sorted_entries(table, &count);
+	if (entries == NULL) {
+		return 1;
+	}
+
+	int ret = 0;
+	char * section = NULL;
+	unsigned long long int section_length = 0;
+	unsigned long long int depth = 0;
+
+	for (unsigned long long int i = 0; ret == 0 && i < count; ++i) {
+		koml_write_entry_t * entry = &entries[i];
+		if (entry->section_length > 0 && (section == NULL || section_length != entry->section_length || memcmp(section, entry->name, section_length) != 0)) {
+			section = entry->name;
+			section_length = entry->section_length;
+			depth = 1;
+			for (unsigned long long int j = 0; j < section_length; ++j) {
+				depth += (section[j] == '.');
+			}
+
+			if (i > 0) {
+				ret = koml_sink_put(sink, "\n", 1);
+			}
+			for (unsigned long long int j = 1; ret == 0 && j < depth; ++j) {
+				ret = koml_sink_put(sink, "\t", 1);
+			}
+			if (ret == 0) {
+				ret = koml_sink_put(sink, "[", 1);
+			}
+			if (ret == 0) {
+				ret = koml_sink_put(sink, section, section_length);
+			}
+			if (ret == 0) {
+				ret = koml_sink_put(sink, "]\n", 2);
+			}
+		}
+
+		if (ret == 0) {
+			char * key = (entry->section_length > 0) ? &entry->name[entry->section_length + 1] : entry->name;
+			koml_symbol_t * symbol = koml_internal_symbol_at(entry->layer, entry->slot);
+			ret = (symbol != NULL) ? koml_internal_write_symbol(sink, symbol, key, depth) : 4;
+		}
+	}
+
+	free(entries);
+
+	if (ret == 0) {
+		ret = koml_sink_flush(sink);
+	}
+
+	return ret;
+}
+
+unsigned long long int koml_table_write_length(koml_table_t * table) {
+	koml_sink_t counter = {
+		.buffer = NULL,
+		.capacity = 0,
+		.length = 0,
+		.callback = NULL,
+		.user = NULL,
+	};
+
+	if (koml_table_write(table, &counter) != 0) {
+		return 0;
+	}
+
+	return counter.length;
+}
+
+int koml_buffer_append(void * user, char * data, unsigned long long int length) {
+	koml_buffer_t * buffer = user;
+
+	if (buffer->length + length > buffer->capacity) {
+		unsigned long long int capacity = (buffer->capacity > 0) ? buffer->capacity : 4096;
+		while (capacity < buffer->length + length) {
+			capacity *= 2;
+		}
+
+		char * grown = realloc(buffer->data, capacity);
+		if (grown == NULL) {
+			return 1;
+		}
+		buffer->data = grown;
+		buffer->capacity = capacity;
+	}
+
+	memcpy(&buffer->data[buffer->length], data, length);
+	buffer->length += length;
+	return 0;
+}
+
+/* json strings: runs without '"', '\\' or control bytes are copied as they are */
+static int koml_internal_json_string(koml_sink_t * sink, char * string, unsigned long long int length) {
+	static char hex[] = "0123456789abcdef";
+	unsigned long long int run = 0;
+	int ret = koml_sink_put(sink, "\"", 1);
+
+	for (unsigned long long int i = 0; ret == 0 && i < length; ++i) {
+		unsigned char c = (unsigned char) string[i];
+		if (c >= 0x20 && c != '"' && c != '\\') {
+			continue;
+		}
+
+		char escape[6] = { '\\', (char) c, '0', '0', hex[c >> 4], hex[c & 15] };
+		unsigned long long int escape_length = 2;
+		switch (c) {
+			case '"': case '\\': break;
+			case '\n': escape[1] = 'n'; break;
+			case '\r': escape[1] = 'r'; break;
+			case '\t': escape[1] = 't'; break;
+			default:
+				escape[1] = 'u';
+				escape_length = 6;
+				break;
+		}
+
+		ret = koml_sink_put(sink, &string[run], i - run);
+		if (ret == 0) {
+			ret = koml_sink_put(sink, escape, escape_length);
+		}
+		run = i + 1;
+	}
+
+	if (ret == 0) {
+		ret = koml_sink_put(sink, &string[run], length - run);
+	}
+	if (ret == 0) {
+		ret = koml_sink_put(sink, "\"", 1);
+	}
+	return ret;
+}
+
+static int koml_internal_msgpack_header(koml_sink_t * sink, unsigned char fix, unsigned char wide, unsigned long long int count, unsigned long long int fix_limit) {
+	unsigned char out[5];
+	unsigned long long int length = 1;
+
+	if (count < fix_limit) {
+		out[0] = fix | (unsigned char) count;
+	} else if (count <= 0xFFFF) {
+		out[0] = wide;
+		out[1] = (unsigned char) (count >> 8);
+		out[2] = (unsigned char) count;
+		length = 3;
+	} else {
+		out[0] = wide + 1;
+		out[1] = (unsigned char) (count >> 24);
+		out[2] = (unsigned char) (count >> 16);
+		out[3] = (unsigned char) (count >> 8);
+		out[4] = (unsigned char) count;
+		length = 5;
+	}
+
+	return koml_sink_put(sink, (char *) out, length);
+}
+
+static int koml_internal_msgpack_string(koml_sink_t * sink, char * string, unsigned long long int length) {
+	int ret = 0;
+
+	if (length >= 32 && length <= 0xFF) {
+		unsigned char out[2] = { 0xd9, (unsigned char) length };
+		ret = koml_sink_put(sink, (char *) out, 2);
+	} else {
+		ret = koml_internal_msgpack_header(sink, 0xa0, 0xda, length, 32);
+	}
+
+	return (ret == 0) ? koml_sink_put(sink, string, length) : ret;
+}
+
+/* one scalar in the smallest encoding: fixints, then int8/16/32; floats stay float32 */
+static int koml_internal_msgpack_scalar(koml_sink_t * sink, koml_type_enum type, void * value) {
+	unsigned char out[5];
+	unsigned long long int length = 1;
+
+	switch (type) {
+		case KOML_TYPE_INT: {
+			int i = *(int *) value;
+			if (i >= -32 && i <= 127) {
+				out[0] = (unsigned char) i;
+			} else if (i >= -128 && i <= 127) {
+				out[0] = 0xd0;
+				out[1] = (unsigned char) i;
+				length = 2;
+			} else if (i >= -32768 && i <= 32767) {
+				out[0] = 0xd1;
+				out[1] = (unsigned char) (i >> 8);
+				out[2] = (unsigned char) i;
+				length = 3;
+			} else {
+				out[0] = 0xd2;
+				out[1] = (unsigned char) (i >> 24);
+				out[2] = (unsigned char) (i >> 16);
+				out[3] = (unsigned char) (i >> 8);
+				out[4] = (unsigned char) i;
+				length = 5;
+			}
+			break;
+		}
+		case KOML_TYPE_FLOAT: {
+			unsigned int bits;
+			memcpy(&bits, value, sizeof(bits));
+			out[0] = 0xca;
+			out[1] = (unsigned char) (bits >> 24);
+			out[2] = (unsigned char) (bits >> 16);
+			out[3] = (unsigned char) (bits >> 8);
+			out[4] = (unsigned char) bits;
+			length = 5;
+			break;
+		}
+		case KOML_TYPE_STRING: {
+			char * string = *(char **) value;
+			return koml_internal_msgpack_string(sink, string, strlen(string));
+		}
+		case KOML_TYPE_BOOLEAN:
+			out[0] = (*(unsigned char *) value) ? 0xc3 : 0xc2;
+			break;
+		default:
+			return 4;
+	}
+
+	return koml_sink_put(sink, (char *) out, length);
+}
+
+/* json has no nan or infinity, so those become null */
+static int koml_internal_json_scalar(koml_sink_t * sink, koml_type_enum type, void * value) {
+	char tmp[64];
+	unsigned long long int length = 0;
+
+	switch (type) {
+		case KOML_TYPE_INT:
+			length = koml_internal_itoa(*(int *) value, tmp);
+			break;
+		case KOML_TYPE_FLOAT:
+			length = koml_internal_ftoa(*(float *) value, tmp);
+			if (length == 0) {
+				return koml_sink_put(sink, "null", 4);
+			}
+			break;
+		case KOML_TYPE_STRING: {
+			char * string = *(char **) value;
+			return koml_internal_json_string(sink, string, strlen(string));
+		}
+		case KOML_TYPE_BOOLEAN:
+			return (*(unsigned char *) value) ? koml_sink_put(sink, "true", 4) : koml_sink_put(sink, "false", 5);
+		default:
+			return 4;
+	}
+
+	return koml_sink_put(sink, tmp, length);
+}
+
+/* arrays nest like their shape: one json/msgpack array per row */
+static int koml_internal_export_value(koml_sink_t * sink, koml_symbol_t * symbol, unsigned char msgpack) {
+	if (symbol->type != KOML_TYPE_ARRAY) {
+		return (msgpack) ? koml_internal_msgpack_scalar(sink, symbol->type, &symbol->data) : koml_internal_json_scalar(sink, symbol->type, &symbol->data);
+	}
+
+	koml_array_t * array = &symbol->data.array;
+	unsigned long long int stride = koml_internal_element_stride(array->type);
+	unsigned long long int outer = (array->shape != NULL) ? array->shape[0] : array->length;
+	int ret = (msgpack) ? koml_internal_msgpack_header(sink, 0x90, 0xdc, outer, 16) : koml_sink_put(sink, "[", 1);
+
+	for (unsigned long long int i = 0; ret == 0 && i < array->length; ++i) {
+		if (i > 0 && !msgpack) {
+			ret = koml_sink_put(sink, ",", 1);
+		}
+
+		unsigned int opens = koml_internal_row_edges(array, i);
+		for (unsigned int k = array->rank - opens; ret == 0 && opens > 0 && k < array->rank; ++k) {
+			ret = (msgpack) ? koml_internal_msgpack_header(sink, 0x90, 0xdc, array->shape[k], 16) : koml_sink_put(sink, "[", 1);
+		}
+
+		void * element = (char *) array->elements.voidptr + i * stride;
+		if (ret == 0) {
+			ret = (msgpack) ? koml_internal_msgpack_scalar(sink, array->type, element) : koml_internal_json_scalar(sink, array->type, element);
+		}
+
+		for (unsigned int n = koml_internal_row_edges(array, i + 1); ret == 0 && !msgpack && n > 0; --n) {
+			ret = koml_sink_put(sink, "]", 1);
+		}
+	}
+
+	if (ret == 0 && !msgpack) {
+		ret = koml_sink_put(sink, "]", 1);
+	}
+	return ret;
+}
+
+static unsigned long long int koml_internal_section_depth(char * section, unsigned long long int length) {
+	unsigned long long int depth = (length > 0) ? 1 : 0;
+	for (unsigned long long int i = 0; i < length; ++i) {
+		depth += (section[i] == '.');
+	}
+	return depth;
+}
+
+/* how many whole leading components two section names share */
+static unsigned long long int koml_internal_common_components(char * a, unsigned long long int a_length, char * b, unsigned long long int b_length) {
+	unsigned long long int common = 0;
+
+	if (a_length == 0 || b_length == 0) {
+		return 0;
+	}
+
+	for (unsigned long long int i = 0;; ++i) {
+		unsigned char a_end = (i == a_length || a[i] == '.');
+		unsigned char b_end = (i == b_length || b[i] == '.');
+		if (a_end != b_end || (!a_end && a[i] != b[i])) {
+			return common;
+		}
+		if (a_end) {
+			++common;
+			if (i == a_length || i == b_length) {
+				return common;
+			}
+		}
+	}
+}
+
+/* members of the object for section (symbols plus distinct child sections); they start at entries[from] since entries are sorted by component */
+static unsigned long long int koml_internal_export_members(koml_write_entry_t * entries, unsigned long long int from, unsigned long long int count, char * section, unsigned long long int section_length) {
+	unsigned long long int members = 0;
+	char * child = NULL;
+	unsigned long long int child_length = 0;
+
+	for (unsigned long long int i = from; i < count; ++i) {
+		koml_write_entry_t * entry = &entries[i];
+		if (section_length > 0 && (entry->section_length < section_length || memcmp(entry->name, section, section_length) != 0 || (entry->section_length > section_length && entry->name[section_length] != '.'))) {
+			break;
+		}
+
+		if (entry->section_length == section_length) {
+			++members;
+			continue;
+		}
+
+		char * name = (section_length > 0) ? &entry->name[section_length + 1] : entry->name;
+		unsigned long long int rest = entry->section_length - (name - entry->name);
+		char * dot = memchr(name, '.', rest);
+		unsigned long long int name_length = (dot != NULL) ? (unsigned long long int) (dot - name) : rest;
+		if (child == NULL || child_length != name_length || memcmp(child, name, name_length) != 0) {
+			++members;
+			child = name;
+			child_length = name_length;
+		}
+	}
+
+	return members;
+}
+
+static int koml_internal_export_key(koml_sink_t * sink, char * key, unsigned long long int length, unsigned char msgpack, unsigned char * comma) {
+	if (msgpack) {
+		return koml_internal_msgpack_string(sink, key, length);
+	}
+
+	int ret = (*comma) ? koml_sink_put(sink, ",", 1) : 0;
+	if (ret == 0) {
+		ret = koml_internal_json_string(sink, key, length);
+	}
+	if (ret == 0) {
+		ret = koml_sink_put(sink, ":", 1);
+	}
+	*comma = 1;
+	return ret;
+}
+
+/* streams the table as one object with a nested object per section component, walking the same section-sorted entries as koml_table_write */
+static int koml_internal_export(koml_table_t * table, koml_sink_t * sink, unsigned char msgpack) {
+	if (table == NULL || sink == NULL || (sink->callback != NULL && sink->buffer == NULL && sink->capacity != 0)) {
+		return 1;
+	}
+
+	unsigned long long int count = 0;
+	koml_write_entry_t * entries = koml_internal_sorted_entries(table, &count);
+	if (entries == NULL) {
+		return 1;
+	}
+
+	char * section = NULL;
+	unsigned long long int section_length = 0;
+	unsigned char comma = 0;
+	int ret = (msgpack) ? koml_internal_msgpack_header(sink, 0x80, 0xde, koml_internal_export_members(entries, 0, count, NULL, 0), 16) : koml_sink_put(sink, "{", 1);
+
+	for (unsigned long long int i = 0; ret == 0 && i < count; ++i) {
+		koml_write_entry_t * entry = &entries[i];
+		if (section_length != entry->section_length || (section_length > 0 && memcmp(section, entry->name, section_length) != 0)) {
+			unsigned long long int common = koml_internal_common_components(section, section_length, entry->name, entry->section_length);
+			for (unsigned long long int n = koml_internal_section_depth(section, section_length); ret == 0 && !msgpack && n > common; --n) {
+				ret = koml_sink_put(sink, "}", 1);
+			}
+
+			/* open each new component: its key, then its object */
+			unsigned long long int at = 0;
+			for (unsigned long long int n = 0; n < common; ++n) {
+				at += strcspn(&entry->name[at], ".:") + 1;
+			}
+			while (ret == 0 && at < entry->section_length) {
+				unsigned long long int length = strcspn(&entry->name[at], ".:");
+				ret = koml_internal_export_key(sink, &entry->name[at], length, msgpack, &comma);
+				if (ret == 0) {
+					ret = (msgpack) ? koml_internal_msgpack_header(sink, 0x80, 0xde, koml_internal_export_members(entries, i, count, entry->name, at + length), 16) : koml_sink_put(sink, "{", 1);
+				}
+				comma = 0;
+				at += length + 1;
+			}
+
+			section = entry->name;
+			section_length = entry->section_length;
+		}
+
+		char * key = (entry->section_length > 0) ? &entry->name[entry->section_length + 1] : entry->name;
+		koml_symbol_t * symbol = koml_internal_symbol_at(entry->layer, entry->slot);
+		if (ret == 0) {
+			ret = koml_internal_export_key(sink, key, strlen(key), msgpack, &comma);
+		}
+		if (ret == 0) {
+			ret = (symbol != NULL) ? koml_internal_export_value(sink, symbol, msgpack) : 4;
+		}
+	}
+
+	free(entries);
+
+	for (unsigned long long int n = koml_internal_section_depth(section, section_length) + 1; ret == 0 && !msgpack && n > 0; --n) {
+		ret = koml_sink_put(sink, "}", 1);
+	}
+	if (ret == 0) {
+		ret = koml_sink_flush(sink);
+	}
+
+	return ret;
+}
+
+int koml_table_to_json(koml_table_t * table, koml_sink_t * sink) {
+	return koml_internal_export(table, sink, 0);
+}
+
+int koml_table_to_msgpack(koml_table_t * table, koml_sink_t * sink) {
+	return koml_internal_export(table, sink, 1);
+}
+
+struct koml_lazy {
+	unsigned long long int start;
+	unsigned long long int length;
+	unsigned char state;
+	/* the load error a failed decode ended with */
+	unsigned char error;
+};
+
+struct koml_telemetry {
+	unsigned int rate;
+	unsigned long long int length;
+	unsigned long long int counts[];
+};
+
+/* per thread: counting down to the next sample, and the xorshift state that jitters the interval so periodic access patterns do not alias with it */
+static __thread unsigned long long int koml_sample_countdown = 0;
+static __thread unsigned long long int koml_sample_state = 0;
+
+static void koml_internal_sample(koml_telemetry_t * telemetry, unsigned long long int slot) {
+	if (koml_sample_countdown > 0) {
+		--koml_sample_countdown;
+		return;
+	}
+
+	if (koml_sample_state == 0) {
+		koml_sample_state = koml_internal_random_seed() | 1;
+	}
+	koml_sample_state ^= koml_sample_state << 13;
+	koml_sample_state ^= koml_sample_state >> 7;
+	koml_sample_state ^= koml_sample_state << 17;
+	koml_sample_countdown = koml_sample_state % (2ULL * telemetry->rate - 1);
+
+	/* shared counts: only about 1 in rate lookups get here, and per-thread arrays would need registering with every table and tearing down with it */
+	if (slot < telemetry->length) {
+		__atomic_add_fetch(&telemetry->counts[slot], 1, __ATOMIC_RELAXED);
+	}
+}
+
+enum {
+	KOML_LAZY_PENDING = 0,
+	KOML_LAZY_DECODED,
+	KOML_LAZY_FAILED,
+	/* on the path of a reference chain being decoded; meeting it again is a cycle */
+	KOML_LAZY_DECODING,
+};
+
+/* a reference recorded while parsing, resolved once every symbol is known */
+typedef struct koml_reference {
+	unsigned long long int slot;
+	unsigned long long int name;
+	unsigned long long int name_length;
+	koml_symbol_t * target;
+	unsigned char state;
+} koml_reference_t;
+
+typedef struct koml_references {
+	koml_reference_t * items;
+	unsigned long long int count;
+	unsigned long long int capacity;
+} koml_references_t;
+
+enum {
+	KOML_REFERENCE_PENDING = 0,
+	KOML_REFERENCE_VISITING,
+	KOML_REFERENCE_RESOLVED,
+	/* koml_validate only: checked while parsing against a type it cannot take, reported when resolution reaches it */
+	KOML_REFERENCE_INVALID,
+};
+
+/* one link of a lazy reference chain: the symbol and the symbol it copies once that is decoded */
+typedef struct koml_lazy_link {
+	unsigned long long int slot;
+	unsigned long long int name;
+	koml_symbol_t * target;
+} koml_lazy_link_t;
+
+static void koml_internal_position(char * buffer, unsigned long long int offset, unsigned long long int * out_line, unsigned long long int * out_column) {
+	unsigned long long int line = 0;
+	unsigned long long int column = 0;
+
+	for (unsigned long long int i = 0; i < offset; ++i) {
+		++column;
+		if (buffer[i] == '\n') {
+			++line;
+			column = 0;
+		}
+	}
+
+	*out_line = line;
+	*out_column = column;
+}
+
+static void koml_internal_error(char * buffer, unsigned long long int offset, char * message) {
+	unsigned long long int line = 0;
+	unsigned long long int column = 0;
+
+	koml_internal_position(buffer, offset, &line, &column);
+	printf("%s (line %llu: column %llu)\n  | ", message, line + 1, column + 1);
+	koml_printline(buffer, line, column);
+	printf("\n  | ");
+	koml_printcursor(column + 1);
+	printf("\n");
+}
+
+typedef enum koml_token_kind {
+	KOML_TOKEN_WORD = 0,
+	KOML_TOKEN_STRING,
+	KOML_TOKEN_OPEN,
+	KOML_TOKEN_CLOSE,
+	KOML_TOKEN_EQUALS,
+	KOML_TOKEN_COMMA,
+	KOML_TOKEN_SEMICOLON,
+	KOML_TOKEN_AT,
+	KOML_TOKEN_END,
+} koml_token_kind_enum;
+
+/* character classes; single-character tokens share their value with the token kind, everything unlisted is part of a word */
+enum {
+	KOML_CLASS_WORD = KOML_TOKEN_WORD,
+	KOML_CLASS_QUOTE = KOML_TOKEN_STRING,
+	KOML_CLASS_SPACE = KOML_TOKEN_END + 1,
+	KOML_CLASS_COMMENT,
+};
+
+static const unsigned char koml_char_classes[256] = {
+	['\t'] = KOML_CLASS_SPACE,
+	['\n'] = KOML_CLASS_SPACE,
+	['\r'] = KOML_CLASS_SPACE,
+	[' '] = KOML_CLASS_SPACE,
+	['|'] = KOML_CLASS_COMMENT,
+	['"'] = KOML_CLASS_QUOTE,
+	['['] = KOML_TOKEN_OPEN,
+	[']'] = KOML_TOKEN_CLOSE,
+	['='] = KOML_TOKEN_EQUALS,
+	[','] = KOML_TOKEN_COMMA,
+	[';'] = KOML_TOKEN_SEMICOLON,
+	['@'] = KOML_TOKEN_AT,
+};
+
+typedef struct koml_token {
+	koml_token_kind_enum kind;
+	unsigned long long int start;
+	unsigned long long int length;
+} koml_token_t;
+
+typedef struct koml_lexer {
+	char * buffer;
+	unsigned long long int i;
+	unsigned long long int end;
+	/* set when the lexer covers a single value, so running out of input ends it like a ';' */
+	unsigned char ranged;
+	/* string literals are checked to be valid utf-8 (KOML_LOAD_UTF8) */
+	unsigned char utf8;
+} koml_lexer_t;
+
+/* string tokens cover the text between the quotes. on error (2, 6) lexer->i is left on the opening quote or bar */
+static int koml_lexer_next(koml_lexer_t * lexer, koml_token_t * out) {
+	char * buffer = lexer->buffer;
+	unsigned long long int i = lexer->i;
+	unsigned long long int end = lexer->end;
+
+	for (;;) {
+		if (i >= end) {
+			out->kind = KOML_TOKEN_END;
+			out->start = end;
+			out->length = 0;
+			lexer->i = end;
+			return 0;
+		}
+
+		unsigned char class = koml_char_classes[(unsigned char) buffer[i]];
+		if (class == KOML_CLASS_SPACE) {
+			++i;
+			continue;
+		}
+
+		if (class == KOML_CLASS_COMMENT) {
+			char * close = memchr(&buffer[i + 1], '|', end - i - 1);
+			if (close == NULL) {
+				lexer->i = i;
+				return 6;
+			}
+			i = close - buffer + 1;
+			continue;
+		}
+
+		if (class == KOML_CLASS_WORD) {
+			unsigned long long int j = i + 1;
+			while (j < end && koml_char_classes[(unsigned char) buffer[j]] == KOML_CLASS_WORD) {
+				++j;
+			}
+			out->kind = KOML_TOKEN_WORD;
+			out->start = i;
+			out->length = j - i;
+			lexer->i = j;
+			return 0;
+		}
+
+		if (class == KOML_CLASS_QUOTE) {
+			char * close = memchr(&buffer[i + 1], '"', end - i - 1);
+			if (close == NULL) {
+				lexer->i = i;
+				return 2;
+			}
+			out->kind = KOML_TOKEN_STRING;
+			out->start = i + 1;
+			out->length = close - &buffer[i + 1];
+			lexer->i = close - buffer + 1;
+			return 0;
+		}
+
+		out->kind = class;
+		out->start = i;
+		out->length = 1;
+		lexer->i = i + 1;
+		return 0;
+	}
+}
+
+static char * koml_lexer_message(int code) {
+	return (code == 6) ? "Comment never ended" : "String literal never ended";
+}
+
+/* one `type name = value;` line; section persists across calls. type is KOML_TYPE_UNKNOWN at the end of the buffer */
+typedef struct koml_statement {
+	koml_type_enum type;
+	koml_type_enum array_type;
+	unsigned int rank;
+	unsigned long long int section;
+	unsigned long long int section_length;
+	unsigned long long int name;
+	unsigned long long int name_length;
+	unsigned long long int value;
+	unsigned long long int end;
+} koml_statement_t;
+
+static koml_type_enum koml_internal_type_letter(char c) {
+	switch (c) {
+		case 'i': return KOML_TYPE_INT;
+		case 'f': return KOML_TYPE_FLOAT;
+		case 's': return KOML_TYPE_STRING;
+		case 'b': return KOML_TYPE_BOOLEAN;
+		case 'a': return KOML_TYPE_ARRAY;
+		default: return KOML_TYPE_UNKNOWN;
+	}
+}
+
+static int koml_internal_statement(koml_lexer_t * lexer, koml_statement_t * statement, unsigned long long int * out_offset, char ** out_message) {
+	char * buffer = lexer->buffer;
+	koml_token_t token;
+	int ret = 0;
+
+	for (;;) {
+		if ((ret = koml_lexer_next(lexer, &token)) != 0) {
+			*out_offset = lexer->i;
+			*out_message = koml_lexer_message(ret);
+			return ret;
+		}
+
+		if (token.kind == KOML_TOKEN_END) {
+			statement->type = KOML_TYPE_UNKNOWN;
+			return 0;
+		}
+
+		if (token.kind != KOML_TOKEN_OPEN) {
+			break;
+		}
+
+		koml_token_t close;
+		if ((ret = koml_lexer_next(lexer, &token)) != 0 || (ret = koml_lexer_next(lexer, &close)) != 0) {
+			*out_offset = lexer->i;
+			*out_message = koml_lexer_message(ret);
+			return ret;
+		}
+
+		if (token.kind != KOML_TOKEN_WORD || close.kind != KOML_TOKEN_CLOSE) {
+			*out_offset = token.start;
+			*out_message = "Invalid section name";
+			return 14;
+		}
+
+		statement->section = token.start;
+		statement->section_length = token.length;
+	}
+
+	/* the type letters may run straight into the name: `aiint` is an int array called int */
+	statement->type = (token.kind == KOML_TOKEN_WORD) ? koml_internal_type_letter(buffer[token.start]) : KOML_TYPE_UNKNOWN;
+	statement->array_type = KOML_TYPE_UNKNOWN;
+	statement->rank = 0;
+	if (statement->type == KOML_TYPE_UNKNOWN) {
+		*out_offset = token.start;
+		*out_message = "Unexpected token";
+		return 9;
+	}
+
+	unsigned long long int at = token.start + 1;
+	unsigned long long int word_end = token.start + token.length;
+
+	if (statement->type == KOML_TYPE_ARRAY) {
+		if (at == word_end) {
+			if ((ret = koml_lexer_next(lexer, &token)) != 0) {
+				*out_offset = lexer->i;
+				*out_message = koml_lexer_message(ret);
+				return ret;
+			}
+			at = token.start;
+			word_end = (token.kind == KOML_TOKEN_WORD) ? token.start + token.length : at;
+		}
+
+		statement->array_type = (at < word_end) ? koml_internal_type_letter(buffer[at]) : KOML_TYPE_UNKNOWN;
+		/* each further 'a' adds a dimension: aai is a matrix of ints */
+		while (statement->array_type == KOML_TYPE_ARRAY && statement->rank < KOML_MAX_RANK) {
+			statement->rank = (statement->rank == 0) ? 2 : statement->rank + 1;
+			++at;
+			statement->array_type = (at < word_end) ? koml_internal_type_letter(buffer[at]) : KOML_TYPE_UNKNOWN;
+		}
+		if (statement->array_type == KOML_TYPE_UNKNOWN || statement->array_type == KOML_TYPE_ARRAY || (statement->rank > 0 && statement->array_type != KOML_TYPE_INT && statement->array_type != KOML_TYPE_FLOAT)) {
+			*out_offset = at;
+			*out_message = "Invalid array type";
+			return 12;
+		}
+		++at;
+	}
+
+	int name_error = (statement->type == KOML_TYPE_ARRAY) ? 15 : (statement->type == KOML_TYPE_INT) ? 13 : 14;
+	if (at == word_end) {
+		if ((ret = koml_lexer_next(lexer, &token)) != 0) {
+			*out_offset = lexer->i;
+			*out_message = koml_lexer_message(ret);
+			return ret;
+		}
+		if (token.kind != KOML_TOKEN_WORD) {
+			*out_offset = token.start;
+			*out_message = "Invalid variable name";
+			return name_error;
+		}
+		at = token.start;
+		word_end = token.start + token.length;
+	}
+
+	statement->name = at;
+	statement->name_length = word_end - at;
+
+	if ((ret = koml_lexer_next(lexer, &token)) != 0) {
+		*out_offset = lexer->i;
+		*out_message = koml_lexer_message(ret);
+		return ret;
+	}
+	if (token.kind != KOML_TOKEN_EQUALS) {
+		*out_offset = token.start;
+		*out_message = "Invalid variable name";
+		return name_error;
+	}
+
+	statement->value = lexer->i;
+	return 0;
+}
+
+/* moves past the value of a statement to its ';' without decoding it, for lazy loading */
+static int koml_internal_skip_value(koml_lexer_t * lexer, koml_statement_t * statement, unsigned long long int * out_offset, char ** out_message) {
+	koml_token_t token;
+
+	do {
+		int ret = koml_lexer_next(lexer, &token);
+		if (ret != 0) {
+			*out_offset = lexer->i;
+			*out_message = koml_lexer_message(ret);
+			return ret;
+		}
+		if (token.kind == KOML_TOKEN_END) {
+			*out_offset = statement->value;
+			*out_message = "Value never ended";
+			return 16;
+		}
+	} while (token.kind != KOML_TOKEN_SEMICOLON);
+	statement->end = token.start;
+
+	return 0;
+}
+
+static int koml_internal_check_scalar(char * word, unsigned long long int length, koml_type_enum type, unsigned char in_array, char ** message) {
+	switch (type) {
+		case KOML_TYPE_INT:
+			for (unsigned long long int i = 0; i < length; ++i) {
+				if (!is_num(word[i])) {
+					length = 0;
+					break;
+				}
+			}
+			if (length == 0) {
+				*message = "Invalid integer value";
+				return (in_array) ? 11 : 8;
+			}
+			return 0;
+		case KOML_TYPE_FLOAT:
+			for (unsigned long long int i = 0; i < length; ++i) {
+				if (!is_num(word[i]) && word[i] != '.') {
+					length = 0;
+					break;
+				}
+			}
+			if (length == 0) {
+				*message = "Invalid float value";
+				return (in_array) ? 10 : 9;
+			}
+			return 0;
+		case KOML_TYPE_BOOLEAN:
+			if (!is_boolean(word, length)) {
+				*message = "Invalid boolean value";
+				return 5;
+			}
+			return 0;
+		default:
+			*message = "Unknown type";
+			return 7;
+	}
+}
+
+/* conversion kernels: widest vectors the build targets, scalar tails. float to int truncates like a c cast */
+static void koml_internal_i32_to_f32(const int * in, float * out, unsigned long long int count) {
+	unsigned long long int i = 0;
+#if defined(__AVX__)
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(&out[i], _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *) &in[i])));
+	}
+#elif defined(__SSE2__)
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(&out[i], _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *) &in[i])));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 4 <= count; i += 4) {
+		vst1q_f32(&out[i], vcvtq_f32_s32(vld1q_s32(&in[i])));
+	}
+#endif
+	for (; i < count; ++i) {
+		out[i] = (float) in[i];
+	}
+}
+
+static void koml_internal_f32_to_i32(const float * in, int * out, unsigned long long int count) {
+	unsigned long long int i = 0;
+#if defined(__AVX__)
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_si256((__m256i *) &out[i], _mm256_cvttps_epi32(_mm256_loadu_ps(&in[i])));
+	}
+#elif defined(__SSE2__)
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_si128((__m128i *) &out[i], _mm_cvttps_epi32(_mm_loadu_ps(&in[i])));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 4 <= count; i += 4) {
+		vst1q_s32(&out[i], vcvtq_s32_f32(vld1q_f32(&in[i])));
+	}
+#endif
+	for (; i < count; ++i) {
+		out[i] = (int) in[i];
+	}
+}
+
+static void koml_internal_i32_to_i64(const int * in, long long int * out, unsigned long long int count) {
+	unsigned long long int i = 0;
+#if defined(__AVX2__)
+	for (; i + 4 <= count; i += 4) {
+		_mm256_storeu_si256((__m256i *) &out[i], _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *) &in[i])));
+	}
+#elif defined(__SSE2__)
+	for (; i + 4 <= count; i += 4) {
+		__m128i value = _mm_loadu_si128((const __m128i *) &in[i]);
+		__m128i sign = _mm_srai_epi32(value, 31);
+		_mm_storeu_si128((__m128i *) &out[i], _mm_unpacklo_epi32(value, sign));
+		_mm_storeu_si128((__m128i *) &out[i + 2], _mm_unpackhi_epi32(value, sign));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 4 <= count; i += 4) {
+		int32x4_t value = vld1q_s32(&in[i]);
+		vst1q_s64((int64_t *) &out[i], vmovl_s32(vget_low_s32(value)));
+		vst1q_s64((int64_t *) &out[i + 2], vmovl_s32(vget_high_s32(value)));
+	}
+#endif
+	for (; i < count; ++i) {
+		out[i] = in[i];
+	}
+}
+
+static void koml_internal_i32_to_f64(const int * in, double * out, unsigned long long int count) {
+	unsigned long long int i = 0;
+#if defined(__AVX__)
+	for (; i + 4 <= count; i += 4) {
+		_mm256_storeu_pd(&out[i], _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *) &in[i])));
+	}
+#elif defined(__SSE2__)
+	for (; i + 4 <= count; i += 4) {
+		__m128i value = _mm_loadu_si128((const __m128i *) &in[i]);
+		_mm_storeu_pd(&out[i], _mm_cvtepi32_pd(value));
+		_mm_storeu_pd(&out[i + 2], _mm_cvtepi32_pd(_mm_unpackhi_epi64(value, value)));
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	for (; i + 4 <= count; i += 4) {
+		int32x4_t value = vld1q_s32(&in[i]);
+		vst1q_f64(&out[i], vcvtq_f64_s64(vmovl_s32(vget_low_s32(value))));
+		vst1q_f64(&out[i + 2], vcvtq_f64_s64(vmovl_s32(vget_high_s32(value))));
+	}
+#endif
+	for (; i < count; ++i) {
+		out[i] = in[i];
+	}
+}
+
+static void koml_internal_f32_to_f64(const float * in, double * out, unsigned long long int count) {
+	unsigned long long int i = 0;
+#if defined(__AVX__)
+	for (; i + 4 <= count; i += 4) {
+		_mm256_storeu_pd(&out[i], _mm256_cvtps_pd(_mm_loadu_ps(&in[i])));
+	}
+#elif defined(__SSE2__)
+	for (; i + 4 <= count; i += 4) {
+		__m128 value = _mm_loadu_ps(&in[i]);
+		_mm_storeu_pd(&out[i], _mm_cvtps_pd(value));
+		_mm_storeu_pd(&out[i + 2], _mm_cvtps_pd(_mm_movehl_ps(value, value)));
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	for (; i + 4 <= count; i += 4) {
+		float32x4_t value = vld1q_f32(&in[i]);
+		vst1q_f64(&out[i], vcvt_f64_f32(vget_low_f32(value)));
+		vst1q_f64(&out[i + 2], vcvt_high_f64_f32(value));
+	}
+#endif
+	for (; i < count; ++i) {
+		out[i] = in[i];
+	}
+}
+
+/* no packed float to int64 conversion below avx-512, so this one stays scalar */
+static void koml_internal_f32_to_i64(const float * in, long long int * out, unsigned long long int count) {
+	for (unsigned long long int i = 0; i < count; ++i) {
+		out[i] = (long long int) in[i];
+	}
+}
+
+static int koml_internal_convert_elements(koml_type_enum from, void * in, koml_element_enum to, void * out, unsigned long long int count) {
+	if (from == KOML_TYPE_INT) {
+		switch (to) {
+			case KOML_ELEMENT_I32:
+				memcpy(out, in, count * sizeof(int));
+				return 0;
+			case KOML_ELEMENT_F32:
+				koml_internal_i32_to_f32(in, out, count);
+				return 0;
+			case KOML_ELEMENT_I64:
+				koml_internal_i32_to_i64(in, out, count);
+				return 0;
+			case KOML_ELEMENT_F64:
+				koml_internal_i32_to_f64(in, out, count);
+				return 0;
+		}
+	} else if (from == KOML_TYPE_FLOAT) {
+		switch (to) {
+			case KOML_ELEMENT_I32:
+				koml_internal_f32_to_i32(in, out, count);
+				return 0;
+			case KOML_ELEMENT_F32:
+				memcpy(out, in, count * sizeof(float));
+				return 0;
+			case KOML_ELEMENT_I64:
+				koml_internal_f32_to_i64(in, out, count);
+				return 0;
+			case KOML_ELEMENT_F64:
+				koml_internal_f32_to_f64(in, out, count);
+				return 0;
+		}
+	}
+
+	return 2;
+}
+
+static int koml_internal_copy_reference(koml_symbol_t * symbol, koml_symbol_t * target) {
+	switch (symbol->type) {
+		case KOML_TYPE_INT:
+			if (target->type == KOML_TYPE_FLOAT) {
+				symbol->data.i32 = (int) target->data.f32;
+			} else if (target->type == KOML_TYPE_INT) {
+				symbol->data.i32 = target->data.i32;
+			} else {
+				return 18;
+			}
+			return 0;
+		case KOML_TYPE_FLOAT:
+			if (target->type == KOML_TYPE_FLOAT) {
+				symbol->data.f32 = target->data.f32;
+			} else if (target->type == KOML_TYPE_INT) {
+				symbol->data.f32 = (float) target->data.i32;
+			} else {
+				return 18;
+			}
+			return 0;
+		case KOML_TYPE_STRING: {
+			if (target->type != KOML_TYPE_STRING) {
+				return 18;
+			}
+			unsigned long long int length = strlen(target->data.string);
+			symbol->data.string = malloc(length + 1);
+			if (symbol->data.string == NULL) {
+				return 1;
+			}
+			memcpy(symbol->data.string, target->data.string, length + 1);
+			symbol->stride = length;
+			return 0;
+		}
+		case KOML_TYPE_BOOLEAN:
+			if (target->type != KOML_TYPE_BOOLEAN) {
+				return 18;
+			}
+			symbol->data.boolean = target->data.boolean;
+			return 0;
+		case KOML_TYPE_ARRAY:
+			break;
+		default:
+			return 19;
+	}
+
+	if (target->type != KOML_TYPE_ARRAY) {
+		return 18;
+	}
+
+	koml_array_t * array = &symbol->data.array;
+	koml_array_t * source = &target->data.array;
+	unsigned char numeric = (array->type == KOML_TYPE_INT || array->type == KOML_TYPE_FLOAT);
+	if ((array->type != source->type && !(numeric && (source->type == KOML_TYPE_INT || source->type == KOML_TYPE_FLOAT))) || array->rank != source->rank) {
+		return 18;
+	}
+
+	if (koml_array_alloc_new_amount(array, source->length) != 0) {
+		return 1;
+	}
+	memcpy(array->strides, source->strides, source->length * sizeof(unsigned long long int));
+
+	if (source->shape != NULL) {
+		array->shape = malloc(source->rank * sizeof(unsigned long long int));
+		if (array->shape == NULL) {
+			return 1;
+		}
+		memcpy(array->shape, source->shape, source->rank * sizeof(unsigned long long int));
+	}
+
+	if (numeric) {
+		return koml_internal_convert_elements(source->type, source->elements.voidptr, (koml_element_enum) array->type, array->elements.voidptr, source->length);
+	}
+
+	for (unsigned long long int i = 0; i < source->length; ++i) {
+		switch (array->type) {
+			case KOML_TYPE_STRING:
+				array->elements.string[i] = malloc(source->strides[i] + 1);
+				if (array->elements.string[i] == NULL) {
+					array->length = i;
+					return 1;
+				}
+				memcpy(array->elements.string[i], source->elements.string[i], source->strides[i] + 1);
+				break;
+			case KOML_TYPE_BOOLEAN:
+				array->elements.boolean[i] = source->elements.boolean[i];
+				break;
+			default:
+				return 19;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * utf-8 validation (keiser-lemire). every byte is classified together with the one before it by three 16-entry lookups:
+ * the high and low nibble of the previous byte and the high nibble of this one. the and of the three is non-zero for
+ * any bad pair; third and fourth continuation bytes are checked against the leads two and three bytes back
+ */
+#define KOML_UTF8_TOO_SHORT (1 << 0)
+#define KOML_UTF8_TOO_LONG (1 << 1)
+#define KOML_UTF8_OVERLONG_3 (1 << 2)
+#define KOML_UTF8_TOO_LARGE (1 << 3)
+#define KOML_UTF8_SURROGATE (1 << 4)
+#define KOML_UTF8_OVERLONG_2 (1 << 5)
+#define KOML_UTF8_TOO_LARGE_1000 (1 << 6)
+#define KOML_UTF8_OVERLONG_4 (1 << 6)
+#define KOML_UTF8_TWO_CONTS (1 << 7)
+#define KOML_UTF8_CARRY (KOML_UTF8_TOO_SHORT | KOML_UTF8_TOO_LONG | KOML_UTF8_TWO_CONTS)
+
+#if defined(__AVX2__)
+#define KOML_UTF8_WIDTH 32
+typedef __m256i koml_utf8_vector_t;
+#define KOML_UTF8_LOAD(p) _mm256_loadu_si256((const __m256i *) (p))
+#define KOML_UTF8_TABLE(t) _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) (t)))
+#define KOML_UTF8_SPLAT(c) _mm256_set1_epi8((char) (c))
+#define KOML_UTF8_AND(a, b) _mm256_and_si256(a, b)
+#define KOML_UTF8_OR(a, b) _mm256_or_si256(a, b)
+#define KOML_UTF8_XOR(a, b) _mm256_xor_si256(a, b)
+#define KOML_UTF8_SUBS(a, b) _mm256_subs_epu8(a, b)
+#define KOML_UTF8_LOOKUP(t, v) _mm256_shuffle_epi8(t, v)
+#define KOML_UTF8_HIGH(v) _mm256_and_si256(_mm256_srli_epi16(v, 4), KOML_UTF8_SPLAT(0x0F))
+#define KOML_UTF8_PREV(v, previous, n) _mm256_alignr_epi8(v, _mm256_permute2x128_si256(previous, v, 0x21), 16 - (n))
+#define KOML_UTF8_ASCII(v) (_mm256_movemask_epi8(v) == 0)
+#define KOML_UTF8_ANY(v) (!_mm256_testz_si256(v, v))
+#elif defined(__SSSE3__)
+#define KOML_UTF8_WIDTH 16
+typedef __m128i koml_utf8_vector_t;
+#define KOML_UTF8_LOAD(p) _mm_loadu_si128((const __m128i *) (p))
+#define KOML_UTF8_TABLE(t) _mm_loadu_si128((const __m128i *) (t))
+#define KOML_UTF8_SPLAT(c) _mm_set1_epi8((char) (c))
+#define KOML_UTF8_AND(a, b) _mm_and_si128(a, b)
+#define KOML_UTF8_OR(a, b) _mm_or_si128(a, b)
+#define KOML_UTF8_XOR(a, b) _mm_xor_si128(a, b)
+#define KOML_UTF8_SUBS(a, b) _mm_subs_epu8(a, b)
+#define KOML_UTF8_LOOKUP(t, v) _mm_shuffle_epi8(t, v)
+#define KOML_UTF8_HIGH(v) _mm_and_si128(_mm_srli_epi16(v, 4), KOML_UTF8_SPLAT(0x0F))
+#define KOML_UTF8_PREV(v, previous, n) _mm_alignr_epi8(v, previous, 16 - (n))
+#define KOML_UTF8_ASCII(v) (_mm_movemask_epi8(v) == 0)
+#define KOML_UTF8_ANY(v) (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF)
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define KOML_UTF8_WIDTH 16
+typedef uint8x16_t koml_utf8_vector_t;
+#define KOML_UTF8_LOAD(p) vld1q_u8(p)
+#define KOML_UTF8_TABLE(t) vld1q_u8(t)
+#define KOML_UTF8_SPLAT(c) vdupq_n_u8(c)
+#define KOML_UTF8_AND(a, b) vandq_u8(a, b)
+#define KOML_UTF8_OR(a, b) vorrq_u8(a, b)
+#define KOML_UTF8_XOR(a, b) veorq_u8(a, b)
+#define KOML_UTF8_SUBS(a, b) vqsubq_u8(a, b)
+#define KOML_UTF8_LOOKUP(t, v) vqtbl1q_u8(t, v)
+#define KOML_UTF8_HIGH(v) vshrq_n_u8(v, 4)
+#define KOML_UTF8_PREV(v, previous, n) vextq_u8(previous, v, 16 - (n))
+#define KOML_UTF8_ASCII(v) (vmaxvq_u8(v) < 0x80)
+#define KOML_UTF8_ANY(v) (vmaxvq_u8(v) != 0)
+#endif
+
+#if defined(KOML_UTF8_WIDTH)
+static const unsigned char koml_utf8_byte_1_high[16] = {
+	/* 0xxx: ascii */
+	KOML_UTF8_TOO_LONG, KOML_UTF8_TOO_LONG, KOML_UTF8_TOO_LONG, KOML_UTF8_TOO_LONG,
+	KOML_UTF8_TOO_LONG, KOML_UTF8_TOO_LONG, KOML_UTF8_TOO_LONG, KOML_UTF8_TOO_LONG,
+	/* 10xx: continuation */
+	KOML_UTF8_TWO_CONTS, KOML_UTF8_TWO_CONTS, KOML_UTF8_TWO_CONTS, KOML_UTF8_TWO_CONTS,
+	/* 110x: two byte lead */
+	KOML_UTF8_TOO_SHORT | KOML_UTF8_OVERLONG_2,
+	KOML_UTF8_TOO_SHORT,
+	/* 1110: three byte lead */
+	KOML_UTF8_TOO_SHORT | KOML_UTF8_OVERLONG_3 | KOML_UTF8_SURROGATE,
+	/* 1111: four byte lead */
+	KOML_UTF8_TOO_SHORT | KOML_UTF8_TOO_LARGE | KOML_UTF8_TOO_LARGE_1000 | KOML_UTF8_OVERLONG_4,
+};
+
+static const unsigned char koml_utf8_byte_1_low[16] = {
+	KOML_UTF8_CARRY | KOML_UTF8_OVERLONG_3 | KOML_UTF8_OVERLONG_2 | KOML_UTF8_OVERLONG_4,
+	KOML_UTF8_CARRY | KOML_UTF8_OVERLONG_2,
+	KOML_UTF8_CARRY,
+	KOML_UTF8_CARRY,
+	KOML_UTF8_CARRY | KOML_UTF8_TOO_LARGE,
+	KOML_UTF8_CARRY | KOML_UTF8_TOO_LARGE | KOML_UTF8_TOO_LARGE_1000,
+	KOML_UTF8_CARRY | KOML_UTF8_TOO_LARGE | KOML_UTF8_TOO_LARGE_1000,
+	KOML_UTF8_CARRY | KOML_UTF8_TOO_LARGE | KOML_UTF8_TOO_LARGE_1000,
+	KOML_UTF8_CARRY | KOML_UTF8_TOO_LARGE | KOML_UTF8_TOO_LARGE_1000,
+	KOML_UTF8_CARRY | KOML_UTF8_TOO_LARGE | KOML_UTF8_TOO_LARGE_1000,
+	KOML_UTF8_CARRY | KOML_UTF8_TOO_LARGE | KOML_UTF8_TOO_LARGE_1000,
+	KOML_UTF8_CARRY | KOML_UTF8_TOO_LARGE | KOML_UTF8_TOO_LARGE_1000,
+	KOML_UTF8_CARRY | KOML_UTF8_TOO_LARGE | KOML_UTF8_TOO_LARGE_1000,
+	KOML_UTF8_CARRY | KOML_UTF8_TOO_LARGE | KOML_UTF8_TOO_LARGE_1000 | KOML_UTF8_SURROGATE,
+	KOML_UTF8_CARRY | KOML_UTF8_TOO_LARGE | KOML_UTF8_TOO_LARGE_1000,
+	KOML_UTF8_CARRY | KOML_UTF8_TOO_LARGE | KOML_UTF8_TOO_LARGE_1000,
+};
+
+static const unsigned char koml_utf8_byte_2_high[16] = {
+	/* 0xxx: ascii */
+	KOML_UTF8_TOO_SHORT, KOML_UTF8_TOO_SHORT, KOML_UTF8_TOO_SHORT, KOML_UTF8_TOO_SHORT,
+	KOML_UTF8_TOO_SHORT, KOML_UTF8_TOO_SHORT, KOML_UTF8_TOO_SHORT, KOML_UTF8_TOO_SHORT,
+	/* 1000 */
+	KOML_UTF8_TOO_LONG | KOML_UTF8_OVERLONG_2 | KOML_UTF8_TWO_CONTS | KOML_UTF8_OVERLONG_3 | KOML_UTF8_TOO_LARGE_1000 | KOML_UTF8_OVERLONG_4,
+	/* 1001 */
+	KOML_UTF8_TOO_LONG | KOML_UTF8_OVERLONG_2 | KOML_UTF8_TWO_CONTS | KOML_UTF8_OVERLONG_3 | KOML_UTF8_TOO_LARGE,
+	/* 101x */
+	KOML_UTF8_TOO_LONG | KOML_UTF8_OVERLONG_2 | KOML_UTF8_TWO_CONTS | KOML_UTF8_SURROGATE | KOML_UTF8_TOO_LARGE,
+	KOML_UTF8_TOO_LONG | KOML_UTF8_OVERLONG_2 | KOML_UTF8_TWO_CONTS | KOML_UTF8_SURROGATE | KOML_UTF8_TOO_LARGE,
+	/* 11xx: lead */
+	KOML_UTF8_TOO_SHORT, KOML_UTF8_TOO_SHORT, KOML_UTF8_TOO_SHORT, KOML_UTF8_TOO_SHORT,
+};
+
+/* bytes above these in the last three positions start a sequence that runs into the next block */
+static const unsigned char koml_utf8_incomplete[32] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1,
+};
+
+static inline koml_utf8_vector_t koml_internal_utf8_block(koml_utf8_vector_t input, koml_utf8_vector_t previous) {
+	koml_utf8_vector_t low_nibble = KOML_UTF8_SPLAT(0x0F);
+	koml_utf8_vector_t prev1 = KOML_UTF8_PREV(input, previous, 1);
+	koml_utf8_vector_t special = KOML_UTF8_AND(KOML_UTF8_AND(
+		KOML_UTF8_LOOKUP(KOML_UTF8_TABLE(koml_utf8_byte_1_high), KOML_UTF8_HIGH(prev1)),
+		KOML_UTF8_LOOKUP(KOML_UTF8_TABLE(koml_utf8_byte_1_low), KOML_UTF8_AND(prev1, low_nibble))),
+		KOML_UTF8_LOOKUP(KOML_UTF8_TABLE(koml_utf8_byte_2_high), KOML_UTF8_HIGH(input)));
+
+	/* bytes two after a 3/4-byte lead or three after a 4-byte lead must be continuations */
+	koml_utf8_vector_t third = KOML_UTF8_SUBS(KOML_UTF8_PREV(input, previous, 2), KOML_UTF8_SPLAT(0xE0 - 0x80));
+	koml_utf8_vector_t fourth = KOML_UTF8_SUBS(KOML_UTF8_PREV(input, previous, 3), KOML_UTF8_SPLAT(0xF0 - 0x80));
+	koml_utf8_vector_t must23 = KOML_UTF8_AND(KOML_UTF8_OR(third, fourth), KOML_UTF8_SPLAT(0x80));
+	return KOML_UTF8_XOR(must23, special);
+}
+#endif
+
+/* offset of the first byte of the first invalid sequence, length when there is none */
+static unsigned long long int koml_internal_utf8_scalar(const unsigned char * p, unsigned long long int length) {
+	unsigned long long int i = 0;
+
+	while (i < length) {
+		if (i + 8 <= length) {
+			unsigned long long int word;
+			memcpy(&word, &p[i], 8);
+			if ((word & 0x8080808080808080ULL) == 0) {
+				i += 8;
+				continue;
+			}
+		}
+
+		unsigned char c = p[i];
+		if (c < 0x80) {
+			++i;
+			continue;
+		}
+
+		unsigned long long int need;
+		unsigned char low = 0x80;
+		unsigned char high = 0xBF;
+		if (c >= 0xC2 && c <= 0xDF) {
+			need = 1;
+		} else if (c >= 0xE0 && c <= 0xEF) {
+			need = 2;
+			low = (c == 0xE0) ? 0xA0 : low;
+			high = (c == 0xED) ? 0x9F : high;
+		} else if (c >= 0xF0 && c <= 0xF4) {
+			need = 3;
+			low = (c == 0xF0) ? 0x90 : low;
+			high = (c == 0xF4) ? 0x8F : high;
+		} else {
+			return i;
+		}
+
+		if (length - i <= need || p[i + 1] < low || p[i + 1] > high) {
+			return i;
+		}
+		for (unsigned long long int k = 2; k <= need; ++k) {
+			if ((p[i + k] & 0xC0) != 0x80) {
+				return i;
+			}
+		}
+		i += need + 1;
+	}
+
+	return length;
+}
+
+/* vector pass over the whole string; only a failing string is rescanned byte by byte to find the offset */
+static unsigned long long int koml_internal_utf8_check(const char * string, unsigned long long int length) {
+	const unsigned char * p = (const unsigned char *) string;
+#if defined(KOML_UTF8_WIDTH)
+	koml_utf8_vector_t limit = KOML_UTF8_LOAD(&koml_utf8_incomplete[32 - KOML_UTF8_WIDTH]);
+	koml_utf8_vector_t previous = KOML_UTF8_SPLAT(0);
+	koml_utf8_vector_t incomplete = previous;
+	koml_utf8_vector_t error = previous;
+	unsigned char tail[KOML_UTF8_WIDTH];
+	unsigned long long int i = 0;
+
+	/* the zero-padded tail block always runs, so a sequence cut off by the end of the string shows up as too short */
+	for (unsigned char last = 0; !last; i += KOML_UTF8_WIDTH) {
+		koml_utf8_vector_t input;
+		if (i + KOML_UTF8_WIDTH <= length) {
+			input = KOML_UTF8_LOAD(&p[i]);
+		} else {
+			memset(tail, 0, KOML_UTF8_WIDTH);
+			memcpy(tail, &p[i], length - i);
+			input = KOML_UTF8_LOAD(tail);
+			last = 1;
+		}
+
+		if (KOML_UTF8_ASCII(input)) {
+			error = KOML_UTF8_OR(error, incomplete);
+			incomplete = KOML_UTF8_SPLAT(0);
+		} else {
+			error = KOML_UTF8_OR(error, koml_internal_utf8_block(input, previous));
+			incomplete = KOML_UTF8_SUBS(input, limit);
+		}
+		previous = input;
+	}
+
+	if (!KOML_UTF8_ANY(error)) {
+		return length;
+	}
+#endif
+	return koml_internal_utf8_scalar(p, length);
+}
+
+/* 21 with out_offset on the bad byte when a string token is not valid utf-8 */
+static int koml_internal_check_utf8(char * buffer, koml_token_t * token, unsigned long long int * out_offset, char ** out_message) {
+	unsigned long long int bad = koml_internal_utf8_check(&buffer[token->start], token->length);
+	if (bad == token->length) {
+		return 0;
+	}
+
+	*out_offset = token->start + bad;
+	*out_message = "Invalid UTF-8 in string literal";
+	return 21;
+}
+
+static int koml_internal_copy_word(char * buffer, koml_token_t * token, char ** out, unsigned long long int * out_length) {
+	*out = malloc(token->length + 1);
+	if (*out == NULL) {
+		return 3;
+	}
+
+	memcpy(*out, &buffer[token->start], token->length);
+	(*out)[token->length] = '\0';
+	*out_length = token->length;
+	return 0;
+}
+
+static void koml_internal_convert(char * word, unsigned long long int length, koml_type_enum type, void * out) {
+	switch (type) {
+		case KOML_TYPE_INT:
+			*(int *) out = wtoi(word, length, 10);
+			break;
+		case KOML_TYPE_FLOAT:
+			*(float *) out = wtof(word, length);
+			break;
+		default:
+			*(unsigned char *) out = wtotf(word, length);
+			break;
+	}
+}
+
+static int koml_internal_array_reserve(koml_array_t * array, unsigned long long int capacity) {
+	unsigned long long int * strides = realloc(array->strides, capacity * sizeof(unsigned long long int));
+	if (strides == NULL) {
+		return 1;
+	}
+	array->strides = strides;
+
+	void * elements = realloc(array->elements.voidptr, capacity * koml_internal_element_stride(array->type));
+	if (elements == NULL) {
+		return 1;
+	}
+	array->elements.voidptr = elements;
+
+	return 0;
+}
+
+/* next token of a value; running out of input is only a terminator for ranged lexers */
+static int koml_internal_value_token(koml_lexer_t * lexer, koml_token_t * token, unsigned long long int value, unsigned long long int * out_offset, char ** out_message) {
+	int ret = koml_lexer_next(lexer, token);
+	if (ret != 0) {
+		*out_offset = lexer->i;
+		*out_message = koml_lexer_message(ret);
+		return ret;
+	}
+
+	if (token->kind == KOML_TOKEN_END && !lexer->ranged) {
+		*out_offset = value;
+		*out_message = "Value never ended";
+		return 16;
+	}
+
+	return 0;
+}
+
+static unsigned char koml_internal_terminator(koml_token_t * token) {
+	return token->kind == KOML_TOKEN_SEMICOLON || token->kind == KOML_TOKEN_END;
+}
+
+/* the leading decimal digits of the 8 bytes at p (swar): returns how many there are and stores their value */
+static unsigned int koml_internal_digits8(char * p, unsigned int * out_value) {
+	unsigned long long int digits = koml_wyread8((unsigned char *) p) - 0x3030303030303030ULL;
+	/* borrows and carries only travel upwards, so the lowest flagged byte is the first non-digit */
+	unsigned long long int flagged = (digits | (digits + 0x7676767676767676ULL)) & 0x8080808080808080ULL;
+	unsigned int count = (flagged != 0) ? __builtin_ctzll(flagged) >> 3 : 8;
+	if (count == 0) {
+		return 0;
+	}
+
+	/* shifting the digits to the top leaves zeros, i.e. leading '0's, in front */
+	digits <<= (8 - count) * 8;
+	digits = (digits * 10) + (digits >> 8);
+	digits = (((digits & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32))) + (((digits >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32)))) >> 32;
+	*out_value = (unsigned int) digits;
+	return count;
+}
+
+static const unsigned long long int koml_pow10_u64[] = { 1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL };
+static const double koml_pow10_f64[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+/* digits from p up to end, 8 at a time while 8 bytes remain. value wraps like wtoi; *out_count is the number of digits */
+static char * koml_internal_digits(char * p, char * end, unsigned int * out_value, unsigned long long int * out_count, unsigned long long int * out_wide) {
+	unsigned int value = 0;
+	unsigned long long int wide = 0;
+	char * start = p;
+
+	for (;;) {
+		unsigned int chunk = 0;
+		unsigned int count = 0;
+		if (end - p >= 8) {
+			count = koml_internal_digits8(p, &chunk);
+		} else {
+			while (count < (unsigned int) (end - p) && p[count] >= '0' && p[count] <= '9') {
+				chunk = chunk * 10 + (p[count] - '0');
+				++count;
+			}
+		}
+
+		value = value * (unsigned int) koml_pow10_u64[count] + chunk;
+		/* exact while it stays below 10^19 */
+		if (p - start + count <= 19) {
+			wide = wide * koml_pow10_u64[count] + chunk;
+		}
+		p += count;
+
+		if (count < 8) {
+			break;
+		}
+	}
+
+	*out_value = value;
+	*out_count = p - start;
+	*out_wide = wide;
+	return p;
+}
+
+/*
+ * fast path for ai/af literals made of plain -123 / -1.25 numbers: parsed straight from the buffer into an array sized
+ * by counting commas up front. returns 0 with the lexer past the ';', or -1 so the general path takes over (and reports
+ * any error) for anything else, such as comments, references or unusual but valid words like "1-2"
+ */
+static int koml_internal_numeric_array(koml_lexer_t * lexer, koml_type_enum array_type, koml_array_t * array) {
+	char * p = &lexer->buffer[lexer->i];
+	char * end = &lexer->buffer[lexer->end];
+
+	char * close = memchr(p, ';', end - p);
+	char * limit = (close != NULL) ? close : end;
+	unsigned long long int capacity = 1;
+	for (char * c = p; c < limit; ++c) {
+		capacity += (*c == ',');
+	}
+
+	if (koml_internal_array_reserve(array, capacity) != 0) {
+		return -1;
+	}
+
+	for (;;) {
+		char * element = p;
+		unsigned char negative = (p < end && *p == '-');
+		p += negative;
+
+		unsigned int value = 0;
+		unsigned long long int count = 0;
+		unsigned long long int wide = 0;
+		p = koml_internal_digits(p, end, &value, &count, &wide);
+
+		if (array_type == KOML_TYPE_INT) {
+			if (count == 0) {
+				return -1;
+			}
+			array->elements.i32[array->length] = (int) ((negative) ? 0U - value : value);
+		} else {
+			unsigned long long int fraction = 0;
+			if (p < end && *p == '.') {
+				unsigned long long int integer = wide;
+				p = koml_internal_digits(p + 1, end, &value, &fraction, &wide);
+				if (fraction == 0) {
+					return -1;
+				}
+				count += fraction;
+				if (count <= 19) {
+					wide = integer * koml_pow10_u64[fraction] + wide;
+				}
+			}
+			if (count == 0) {
+				return -1;
+			}
+
+			/* exact mantissa and power of ten: one correctly rounded division, the same double strtod returns */
+			double number;
+			if (count <= 19 && wide < (1ULL << 53) && fraction <= 22) {
+				number = (double) wide / koml_pow10_f64[fraction];
+				number = (negative) ? -number : number;
+			} else {
+				number = strtod(element, NULL);
+			}
+			array->elements.f32[array->length] = (float) number;
+		}
+		array->strides[array->length] = 4;
+		++array->length;
+
+		if (p < end && koml_char_classes[(unsigned char) *p] == KOML_CLASS_WORD) {
+			return -1;
+		}
+		while (p < end && koml_char_classes[(unsigned char) *p] == KOML_CLASS_SPACE) {
+			++p;
+		}
+
+		if (p == end) {
+			if (!lexer->ranged) {
+				return -1;
+			}
+			lexer->i = lexer->end;
+			return 0;
+		}
+
+		if (*p == ';') {
+			lexer->i = p + 1 - lexer->buffer;
+			return 0;
+		}
+
+		if (*p != ',' || array->length == capacity) {
+			return -1;
+		}
+
+		++p;
+		while (p < end && koml_char_classes[(unsigned char) *p] == KOML_CLASS_SPACE) {
+			++p;
+		}
+	}
+}
+
+/*
+ * the value of an aa..i/aa..f array: comma-separated rows in brackets, nested rank - 1 deep, with scalars in the innermost
+ * rows. every row at one depth must have the same length; the elements are appended in row-major order
+ */
+static int koml_internal_shaped_array(koml_lexer_t * lexer, koml_token_t * token, koml_type_enum array_type, unsigned int rank, koml_array_t * array, unsigned long long int value, unsigned long long int * out_offset, char ** out_message) {
+	char * buffer = lexer->buffer;
+	unsigned long long int stride = koml_internal_element_stride(array_type);
+	unsigned long long int shape[KOML_MAX_RANK] = { 0 };
+	unsigned long long int counts[KOML_MAX_RANK] = { 0 };
+	unsigned long long int length = 0;
+	unsigned int depth = 0;
+	int ret = 0;
+
+	for (;;) {
+		*out_offset = token->start;
+		if (depth + 1 < rank) {
+			if (token->kind != KOML_TOKEN_OPEN) {
+				*out_message = "Invalid multi-dimensional array";
+				return 22;
+			}
+			++counts[depth];
+			counts[++depth] = 0;
+			if ((ret = koml_internal_value_token(lexer, token, value, out_offset, out_message)) != 0) {
+				return ret;
+			}
+			continue;
+		}
+
+		unsigned long long int word_length = (token->kind == KOML_TOKEN_WORD) ? token->length : 0;
+		if ((ret = koml_internal_check_scalar(&buffer[token->start], word_length, array_type, 1, out_message)) != 0) {
+			return ret;
+		}
+		if (array != NULL) {
+			if ((length & (length - 1)) == 0 && koml_internal_array_reserve(array, (length > 0) ? length * 2 : 4) != 0) {
+				*out_message = "Internal error";
+				return 1;
+			}
+			koml_internal_convert(&buffer[token->start], word_length, array_type, (char *) array->elements.voidptr + length * stride);
+			array->strides[length] = stride;
+			array->length = length + 1;
+		}
+		++length;
+		++counts[depth];
+
+		/* after an element: ',' continues the row, ']' closes it (and the row is an element of its parent), ';' ends the value */
+		for (;;) {
+			if ((ret = koml_internal_value_token(lexer, token, value, out_offset, out_message)) != 0) {
+				return ret;
+			}
+			*out_offset = token->start;
+
+			if (token->kind == KOML_TOKEN_CLOSE && depth > 0) {
+				if (shape[depth] != 0 && shape[depth] != counts[depth]) {
+					*out_message = "Array rows differ in length";
+					return 22;
+				}
+				shape[depth] = counts[depth];
+				--depth;
+				continue;
+			}
+
+			if (koml_internal_terminator(token) && depth == 0) {
+				shape[0] = counts[0];
+				if (array != NULL) {
+					array->shape = malloc(rank * sizeof(unsigned long long int));
+					if (array->shape == NULL) {
+						*out_message = "Internal error";
+						return 1;
+					}
+					memcpy(array->shape, shape, rank * sizeof(unsigned long long int));
+				}
+				return 0;
+			}
+
+			if (token->kind != KOML_TOKEN_COMMA) {
+				*out_message = "Invalid multi-dimensional array";
+				return 22;
+			}
+			if ((ret = koml_internal_value_token(lexer, token, value, out_offset, out_message)) != 0) {
+				return ret;
+			}
+			break;
+		}
+	}
+}
+
+/*
+ * reads one value and its terminating ';' from the lexer. a reference is handed back through out_reference
+ * (kind KOML_TOKEN_AT, empty name when malformed) without being resolved; a literal is checked against type and,
+ * when out != NULL, decoded into it. scalars are one word, strings one quoted literal, arrays comma-separated
+ * elements (string arrays may be empty or end in a comma)
+ */
+static int koml_internal_value(koml_lexer_t * lexer, koml_type_enum type, koml_type_enum array_type, unsigned int rank, koml_symbol_t * out, koml_token_t * out_reference, unsigned long long int * out_offset, char ** out_message) {
+	char * buffer = lexer->buffer;
+	unsigned long long int value = lexer->i;
+	koml_token_t token;
+	koml_token_t next;
+	int ret = 0;
+
+	out_reference->kind = KOML_TOKEN_END;
+	if ((ret = koml_internal_value_token(lexer, &token, value, out_offset, out_message)) != 0) {
+		return ret;
+	}
+
+	if (token.kind == KOML_TOKEN_AT) {
+		out_reference->kind = KOML_TOKEN_AT;
+		out_reference->start = token.start + 1;
+		out_reference->length = 0;
+
+		if ((ret = koml_internal_value_token(lexer, &token, value, out_offset, out_message)) != 0) {
+			return ret;
+		}
+		if (token.kind != KOML_TOKEN_WORD) {
+			return 0;
+		}
+		if ((ret = koml_internal_value_token(lexer, &next, value, out_offset, out_message)) != 0) {
+			return ret;
+		}
+		if (koml_internal_terminator(&next)) {
+			out_reference->start = token.start;
+			out_reference->length = token.length;
+		}
+		return 0;
+	}
+
+	if (type != KOML_TYPE_ARRAY) {
+		if (!koml_internal_terminator(&token) && (ret = koml_internal_value_token(lexer, &next, value, out_offset, out_message)) != 0) {
+			return ret;
+		}
+		*out_offset = token.start;
+		unsigned char single = !koml_internal_terminator(&token) && koml_internal_terminator(&next);
+
+		if (type == KOML_TYPE_STRING) {
+			if (token.kind != KOML_TOKEN_STRING || !single) {
+				*out_message = "Invalid string literal";
+				return 10;
+			}
+			if (lexer->utf8 && (ret = koml_internal_check_utf8(buffer, &token, out_offset, out_message)) != 0) {
+				return ret;
+			}
+			if (out != NULL && (ret = koml_internal_copy_word(buffer, &token, &out->data.string, &out->stride)) != 0) {
+				*out_message = "Failed to allocate string buffer";
+			}
+			return ret;
+		}
+
+		unsigned long long int length = (token.kind == KOML_TOKEN_WORD && single) ? token.length : 0;
+		ret = koml_internal_check_scalar(&buffer[token.start], length, type, 0, out_message);
+		if (ret == 0 && out != NULL) {
+			koml_internal_convert(&buffer[token.start], length, type, &out->data);
+		}
+		return ret;
+	}
+
+	koml_array_t * array = (out != NULL) ? &out->data.array : NULL;
+	unsigned long long int stride = koml_internal_element_stride(array_type);
+
+	if (rank > 0) {
+		return koml_internal_shaped_array(lexer, &token, array_type, rank, array, value, out_offset, out_message);
+	}
+
+	if (array != NULL && (array_type == KOML_TYPE_INT || array_type == KOML_TYPE_FLOAT) && token.kind == KOML_TOKEN_WORD) {
+		unsigned long long int resume = lexer->i;
+		lexer->i = token.start;
+		if (koml_internal_numeric_array(lexer, array_type, array) == 0) {
+			return 0;
+		}
+		lexer->i = resume;
+		array->length = 0;
+	}
+
+	for (;;) {
+		if (koml_internal_terminator(&token)) {
+			if (array_type == KOML_TYPE_STRING) {
+				return 0;
+			}
+			next = token;
+		} else if ((ret = koml_internal_value_token(lexer, &next, value, out_offset, out_message)) != 0) {
+			return ret;
+		}
+		*out_offset = token.start;
+
+		unsigned char separated = !koml_internal_terminator(&token) && (next.kind == KOML_TOKEN_COMMA || koml_internal_terminator(&next));
+		if (array != NULL && (array->length & (array->length - 1)) == 0 && koml_internal_array_reserve(array, (array->length > 0) ? array->length * 2 : 4) != 0) {
+			*out_message = "Internal error";
+			return 1;
+		}
+
+		if (array_type == KOML_TYPE_STRING) {
+			if (token.kind != KOML_TOKEN_STRING || !separated) {
+				*out_message = "Invalid string literal";
+				return 10;
+			}
+			if (lexer->utf8 && (ret = koml_internal_check_utf8(buffer, &token, out_offset, out_message)) != 0) {
+				return ret;
+			}
+			if (array != NULL) {
+				if ((ret = koml_internal_copy_word(buffer, &token, &array->elements.string[array->length], &array->strides[array->length])) != 0) {
+					*out_message = "Failed to allocate string buffer";
+					return ret;
+				}
+				++array->length;
+			}
+		} else {
+			unsigned long long int length = (token.kind == KOML_TOKEN_WORD && separated) ? token.length : 0;
+			if ((ret = koml_internal_check_scalar(&buffer[token.start], length, array_type, 1, out_message)) != 0) {
+				return ret;
+			}
+			if (array != NULL) {
+				koml_internal_convert(&buffer[token.start], length, array_type, (char *) array->elements.voidptr + array->length * stride);
+				array->strides[array->length] = stride;
+				++array->length;
+			}
+		}
+
+		if (next.kind != KOML_TOKEN_COMMA) {
+			return 0;
+		}
+		if ((ret = koml_internal_value_token(lexer, &token, value, out_offset, out_message)) != 0) {
+			return ret;
+		}
+	}
+}
+
+/* decodes the next value from the lexer into table->symbols[index]; a reference is left to the caller through out_reference */
+static int koml_internal_decode_value(koml_table_t * table, unsigned long long int index, koml_lexer_t * lexer, koml_token_t * out_reference) {
+	koml_symbol_t * symbol = &table->symbols[index];
+	unsigned long long int offset = lexer->i;
+	char * message = NULL;
+
+	koml_type_enum array_type = (symbol->type == KOML_TYPE_ARRAY) ? symbol->data.array.type : KOML_TYPE_UNKNOWN;
+	unsigned int rank = (symbol->type == KOML_TYPE_ARRAY) ? symbol->data.array.rank : 0;
+	int ret = koml_internal_value(lexer, symbol->type, array_type, rank, symbol, out_reference, &offset, &message);
+	if (ret != 0) {
+		koml_internal_error(lexer->buffer, offset, message);
+	}
+	return ret;
+}
+
+/* what a reference from slot names: any symbol of the table but slot itself, else the base (unsampled). out_slot is the target's slot in table, or -1 */
+static koml_symbol_t * koml_internal_reference_find(koml_table_t * table, unsigned long long int slot, char * name, unsigned long long int name_length, long long int * out_slot) {
+	unsigned long long int hash = koml_hash(name, name_length, table->seed);
+	long long int found = koml_internal_find(table, name, name_length, hash);
+	*out_slot = -1;
+	if (found >= 0 && (unsigned long long int) found != slot) {
+		*out_slot = found;
+		return &table->symbols[found];
+	}
+
+	/* overlays share their base's seed, so the hash carries over */
+	return (table->base != NULL) ? koml_internal_lookup(table->base, name, name_length, table->seed, hash, 0, NULL) : NULL;
+}
+
+static int koml_internal_reference_copy(koml_symbol_t * symbol, koml_symbol_t * target, char * buffer, unsigned long long int name) {
+	int ret = koml_internal_copy_reference(symbol, target);
+	if (ret != 0) {
+		koml_internal_error(buffer, name - 1, (ret == 1) ? "Internal error" : "Invalid type of variable reference");
+	}
+	return ret;
+}
+
+static int koml_internal_reference_push(koml_references_t * references, unsigned long long int slot, koml_token_t * reference) {
+	if (references->count == references->capacity) {
+		unsigned long long int capacity = (references->capacity > 0) ? references->capacity * 2 : 16;
+		koml_reference_t * items = realloc(references->items, capacity * sizeof(koml_reference_t));
+		if (items == NULL) {
+			return 1;
+		}
+		references->items = items;
+		references->capacity = capacity;
+	}
+
+	references->items[references->count++] = (koml_reference_t) {
+		.slot = slot,
+		.name = reference->start,
+		.name_length = reference->length,
+	};
+	return 0;
+}
+
+/*
+ * resolves every recorded reference through the table's index. each one follows its chain to a plain value (or a link
+ * resolved already), marking the links it passes, then copies back along the chain, so every link is copied once.
+ * meeting a marked link again is a cycle
+ */
+static int koml_internal_resolve(koml_table_t * table, char * buffer, koml_references_t * references) {
+	unsigned long long int * by_slot = calloc(table->length + 1, sizeof(unsigned long long int));
+	unsigned long long int * path = malloc((references->count + 1) * sizeof(unsigned long long int));
+	if (by_slot == NULL || path == NULL) {
+		free(by_slot);
+		free(path);
+		koml_internal_error(buffer, 0, "Internal error");
+		return 1;
+	}
+
+	/* reference index + 1 per slot, so a target that is itself a reference is followed */
+	for (unsigned long long int i = 0; i < references->count; ++i) {
+		by_slot[references->items[i].slot] = i + 1;
+	}
+
+	int ret = 0;
+	for (unsigned long long int i = 0; ret == 0 && i < references->count; ++i) {
+		unsigned long long int depth = 0;
+		unsigned long long int at = i;
+		while (references->items[at].state == KOML_REFERENCE_PENDING) {
+			koml_reference_t * reference = &references->items[at];
+			reference->state = KOML_REFERENCE_VISITING;
+			path[depth++] = at;
+
+			long long int slot;
+			reference->target = koml_internal_reference_find(table, reference->slot, &buffer[reference->name], reference->name_length, &slot);
+			if (reference->target == NULL) {
+				koml_internal_error(buffer, reference->name - 1, "Variable reference to undefined symbol");
+				ret = 17;
+				break;
+			}
+
+			if (slot < 0 || by_slot[slot] == 0) {
+				break;
+			}
+			at = by_slot[slot] - 1;
+			if (references->items[at].state == KOML_REFERENCE_VISITING) {
+				koml_internal_error(buffer, reference->name - 1, "Circular variable reference");
+				ret = 23;
+				break;
+			}
+		}
+
+		while (ret == 0 && depth > 0) {
+			koml_reference_t * reference = &references->items[path[--depth]];
+			ret = koml_internal_reference_copy(&table->symbols[reference->slot], reference->target, buffer, reference->name);
+			reference->state = KOML_REFERENCE_RESOLVED;
+		}
+	}
+
+	free(by_slot);
+	free(path);
+	return ret;
+}
+
+/*
+ * serializes first lookups of lazy values, so each is decoded once and a decoding mark on a chain is always this thread's own.
+ * recursive because a reference from an overlay may decode a value of its (lazy) base
+ */
+static pthread_mutex_t koml_lazy_lock;
+static pthread_once_t koml_lazy_lock_once = PTHREAD_ONCE_INIT;
+
+static void koml_internal_lazy_lock_init(void) {
+	pthread_mutexattr_t attributes;
+	pthread_mutexattr_init(&attributes);
+	pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&koml_lazy_lock, &attributes);
+	pthread_mutexattr_destroy(&attributes);
+}
+
+/* decodes a lazy symbol under koml_lazy_lock. a reference chain is walked with an explicit path rather than recursion, then copied back once its end is decoded */
+static int koml_internal_decode(koml_table_t * table, unsigned long long int index) {
+	koml_lazy_link_t local[16];
+	koml_lazy_link_t * path = local;
+	unsigned long long int capacity = sizeof(local) / sizeof(local[0]);
+	unsigned long long int depth = 0;
+	unsigned long long int at = index;
+	int ret = 0;
+
+	for (;;) {
+		koml_lexer_t lexer = {
+			.buffer = table->source,
+			.i = table->lazy[at].start,
+			.end = table->lazy[at].start + table->lazy[at].length,
+			.ranged = 1,
+			.utf8 = (table->flags & KOML_TABLE_UTF8) != 0,
+		};
+		koml_token_t reference;
+
+		__atomic_store_n(&table->lazy[at].state, KOML_LAZY_DECODING, __ATOMIC_RELAXED);
+		if ((ret = koml_internal_decode_value(table, at, &lexer, &reference)) != 0) {
+			table->lazy[at].error = ret;
+			__atomic_store_n(&table->lazy[at].state, KOML_LAZY_FAILED, __ATOMIC_RELEASE);
+			break;
+		}
+		if (reference.kind != KOML_TOKEN_AT) {
+			__atomic_store_n(&table->lazy[at].state, KOML_LAZY_DECODED, __ATOMIC_RELEASE);
+			break;
+		}
+
+		if (depth == capacity) {
+			koml_lazy_link_t * grown = malloc(capacity * 2 * sizeof(koml_lazy_link_t));
+			if (grown == NULL) {
+				koml_internal_error(table->source, reference.start, "Internal error");
+				ret = 1;
+				table->lazy[at].error = ret;
+				__atomic_store_n(&table->lazy[at].state, KOML_LAZY_FAILED, __ATOMIC_RELEASE);
+				break;
+			}
+			memcpy(grown, path, depth * sizeof(koml_lazy_link_t));
+			if (path != local) {
+				free(path);
+			}
+			path = grown;
+			capacity *= 2;
+		}
+
+		long long int slot;
+		char * name = &table->source[reference.start];
+		koml_symbol_t * target = koml_internal_reference_find(table, at, name, reference.length, &slot);
+		path[depth].slot = at;
+		path[depth].name = reference.start;
+		path[depth].target = target;
+		++depth;
+
+		unsigned char state = (slot >= 0) ? __atomic_load_n(&table->lazy[slot].state, __ATOMIC_RELAXED) : KOML_LAZY_DECODED;
+		if (target == NULL || state == KOML_LAZY_FAILED) {
+			koml_internal_error(table->source, reference.start - 1, "Variable reference to undefined symbol");
+			ret = 17;
+			break;
+		}
+		if (state == KOML_LAZY_DECODING) {
+			koml_internal_error(table->source, reference.start - 1, "Circular variable reference");
+			ret = 23;
+			break;
+		}
+		if (state == KOML_LAZY_DECODED) {
+			break;
+		}
+		at = slot;
+	}
+
+	/* every link copies from the one after it; after a failure they all fail */
+	while (depth > 0) {
+		koml_lazy_link_t * link = &path[--depth];
+		if (ret == 0) {
+			ret = koml_internal_reference_copy(&table->symbols[link->slot], link->target, table->source, link->name);
+		}
+		table->lazy[link->slot].error = ret;
+		__atomic_store_n(&table->lazy[link->slot].state, (ret == 0) ? KOML_LAZY_DECODED : KOML_LAZY_FAILED, __ATOMIC_RELEASE);
+	}
+
+	if (path != local) {
+		free(path);
+	}
+	return ret;
+}
+
+/* decoded values are published with a release store of their state, so the lock is only taken until a slot settles */
+static koml_symbol_t * koml_internal_symbol_at(koml_table_t * table, unsigned long long int index) {
+	if (table->lazy == NULL) {
+		return &table->symbols[index];
+	}
+
+	unsigned char state = __atomic_load_n(&table->lazy[index].state, __ATOMIC_ACQUIRE);
+	if (state == KOML_LAZY_PENDING || state == KOML_LAZY_DECODING) {
+		pthread_once(&koml_lazy_lock_once, koml_internal_lazy_lock_init);
+		pthread_mutex_lock(&koml_lazy_lock);
+		state = __atomic_load_n(&table->lazy[index].state, __ATOMIC_RELAXED);
+		if (state == KOML_LAZY_PENDING) {
+			state = (koml_internal_decode(table, index) == 0) ? KOML_LAZY_DECODED : KOML_LAZY_FAILED;
+		}
+		pthread_mutex_unlock(&koml_lazy_lock);
+	}
+
+	return (state == KOML_LAZY_DECODED) ? &table->symbols[index] : NULL;
+}
+
+int koml_table_load(koml_table_t * out_table, char * buffer, unsigned long long int buffer_length) {
+	return koml_table_load_ex(out_table, buffer, buffer_length, NULL);
+}
+
+static unsigned long long int koml_type_strides[] = { 0, 4, 4, 0, 1, 0 };
+
+int koml_table_load_ex(koml_table_t * out_table, char * buffer, unsigned long long int buffer_length, koml_load_options_t * options) {
+	if (buffer == NULL || buffer_length == 0) {
+		return 1;
+	}
+
+	if (options != NULL && (options->flags & KOML_LOAD_CACHE) && options->cache != NULL && options->base == NULL) {
+		return koml_internal_load_cached(out_table, buffer, buffer_length, options);
+	}
+
+	koml_internal_table_init(out_table);
+
+	/* overlays hash with their base's seed so one hash serves the whole chain */
+	if (options != NULL && options->base != NULL) {
+		out_table->base = koml_table_retain(options->base);
+		out_table->seed = options->base->seed;
+	} else if (options != NULL && (options->flags & KOML_LOAD_SEED)) {
+		out_table->seed = options->seed;
+	}
+
+	unsigned char lazy = (options != NULL && (options->flags & KOML_LOAD_LAZY));
+	unsigned char utf8 = (options != NULL && (options->flags & KOML_LOAD_UTF8));
+	if (lazy) {
+		out_table->source = buffer;
+		out_table->flags |= (utf8) ? KOML_TABLE_UTF8 : 0;
+	}
+
+	koml_lexer_t lexer = {
+		.buffer = buffer,
+		.i = 0,
+		.end = buffer_length,
+		.utf8 = utf8,
+	};
+	koml_statement_t statement = {
+		.type = KOML_TYPE_UNKNOWN,
+	};
+	/* eager loads resolve references once the whole file is indexed, so they may point anywhere in it */
+	koml_references_t references = { 0 };
+
+	for (;;) {
+		unsigned long long int offset = 0;
+		char * message = NULL;
+		int ret = koml_internal_statement(&lexer, &statement, &offset, &message);
+		if (ret != 0) {
+			koml_internal_error(buffer, offset, message);
+			free(references.items);
+			return ret;
+		}
+
+		if (statement.type == KOML_TYPE_UNKNOWN) {
+			break;
+		}
+
+		if (koml_table_alloc_new(out_table) != 0) {
+			koml_internal_error(buffer, statement.name, "Internal error");
+			free(references.items);
+			return 1;
+		}
+
+		unsigned long long int index = out_table->length - 1;
+		koml_symbol_t * symbol = &out_table->symbols[index];
+		symbol->type = statement.type;
+		symbol->stride = koml_type_strides[statement.type];
+		symbol->data.array.type = statement.array_type;
+		symbol->data.array.rank = statement.rank;
+
+		unsigned long long int prefix = (statement.section_length > 0) ? statement.section_length + 1 : 0;
+		unsigned long long int name_length = prefix + statement.name_length;
+		symbol->name = malloc(name_length + 1);
+		if (symbol->name == NULL) {
+			koml_internal_error(buffer, statement.name, "Internal error");
+			free(references.items);
+			return 1;
+		}
+
+		if (prefix > 0) {
+			memcpy(symbol->name, &buffer[statement.section], statement.section_length);
+			symbol->name[statement.section_length] = ':';
+		}
+		memcpy(&symbol->name[prefix], &buffer[statement.name], statement.name_length);
+		symbol->name[name_length] = '\0';
+		out_table->hashes[index] = koml_hash(symbol->name, name_length, out_table->seed);
+
+		if (!lazy) {
+			koml_token_t reference;
+			ret = koml_internal_decode_value(out_table, index, &lexer, &reference);
+			if (ret != 0) {
+				free(references.items);
+				return ret;
+			}
+
+			if (reference.kind == KOML_TOKEN_AT && koml_internal_reference_push(&references, index, &reference) != 0) {
+				koml_internal_error(buffer, reference.start, "Internal error");
+				free(references.items);
+				return 1;
+			}
+			continue;
+		}
+
+		if ((ret = koml_internal_skip_value(&lexer, &statement, &offset, &message)) != 0) {
+			koml_internal_error(buffer, offset, message);
+			return ret;
+		}
+
+		struct koml_lazy * ranges = realloc(out_table->lazy, out_table->length * sizeof(struct koml_lazy));
+		if (ranges == NULL) {
+			koml_internal_error(buffer, statement.value, "Internal error");
+			return 1;
+		}
+
+		out_table->lazy = ranges;
+		out_table->lazy[index].start = statement.value;
+		out_table->lazy[index].length = statement.end - statement.value;
+		out_table->lazy[index].state = KOML_LAZY_PENDING;
+		out_table->lazy[index].error = 0;
+	}
+
+	if (koml_internal_index_build(out_table) != 0) {
+		printf("Failed to allocate symbol index\n");
+		free(references.items);
+		return 1;
+	}
+
+	int ret = (references.count > 0) ? koml_internal_resolve(out_table, buffer, &references) : 0;
+	free(references.items);
+	return ret;
+}
+
+koml_symbol_t * koml_table_symbol(koml_table_t * table, char * name) {
+	return koml_table_symbol_word(table, name, strlen(name));
+}
+
+koml_symbol_t * koml_table_symbol_word(koml_table_t * table, char * name, unsigned long long int name_length) {
+	return koml_table_symbol_hash(table, name, name_length, koml_hash(name, name_length, table->seed));
+}
+
+/*
+ * hash is name's hash under seed; each layer with another seed hashes it again. lookups the library makes on its own behalf
+ * (diff, merge, schema checks) pass sample = 0 so they do not skew the hot-key counts. out_error (if not NULL) tells a lazy value
+ * that failed to decode (its load error) from a missing key (0)
+ */
+static koml_symbol_t * koml_internal_lookup(koml_table_t * table, char * name, unsigned long long int name_length, unsigned long long int seed, unsigned long long int hash, unsigned char sample, int * out_error) {
+	if (out_error != NULL) {
+		*out_error = 0;
+	}
+
+	for (; table != NULL; table = table->base) {
+		if (table->seed != seed) {
+			seed = table->seed;
+			hash = koml_hash(name, name_length, seed);
+		}
+
+		long long int slot = koml_internal_find(table, name, name_length, hash);
+		if (slot >= 0) {
+			if (sample && table->telemetry != NULL) {
+				koml_internal_sample(table->telemetry, slot);
+			}
+			koml_symbol_t * symbol = koml_internal_symbol_at(table, slot);
+			if (symbol == NULL && out_error != NULL) {
+				*out_error = table->lazy[slot].error;
+			}
+
+			return symbol;
+		}
+	}
+
+	return NULL;
+}
+
+koml_symbol_t * koml_table_symbol_hash(koml_table_t * table, char * name, unsigned long long int name_length, unsigned long long int hash) {
+	return koml_internal_lookup(table, name, name_length, table->seed, hash, 1, NULL);
+}
+
+koml_symbol_t * koml_table_symbol_status(koml_table_t * table, char * name, unsigned long long int name_length, int * out_error) {
+	return koml_internal_lookup(table, name, name_length, table->seed, koml_hash(name, name_length, table->seed), 1, out_error);
+}
+
+static koml_symbol_t * koml_internal_symbol_unsampled(koml_table_t * table, char * name) {
+	unsigned long long int name_length = strlen(name);
+	return koml_internal_lookup(table, name, name_length, table->seed, koml_hash(name, name_length, table->seed), 0, NULL);
+}
+
+/* a probe with the stored hash; the key is only hashed again when the table's seed differs from the one it was resolved under */
+static void koml_internal_handle_bind(koml_table_t * table, koml_handle_t * handle) {
+	long long int slot = koml_internal_find(table, handle->name, handle->name_length, handle->hash);
+	if (slot < 0) {
+		unsigned long long int hash = koml_hash(handle->name, handle->name_length, table->seed);
+		if (hash != handle->hash) {
+			handle->hash = hash;
+			slot = koml_internal_find(table, handle->name, handle->name_length, hash);
+		}
+	}
+
+	handle->slot = (slot >= 0) ? (unsigned long long int) slot : ~0ULL;
+	handle->generation = table->generation;
+}
+
+koml_handle_t koml_table_resolve(koml_table_t * table, char * name) {
+	koml_handle_t handle = {
+		.name = name,
+		.name_length = strlen(name),
+	};
+
+	handle.hash = koml_hash(name, handle.name_length, table->seed);
+	koml_internal_handle_bind(table, &handle);
+	return handle;
+}
+
+koml_symbol_t * koml_table_symbol_handle(koml_table_t * table, koml_handle_t * handle) {
+	if (handle->generation != table->generation) {
+		koml_internal_handle_bind(table, handle);
+	}
+
+	if (handle->slot < table->length) {
+		if (table->telemetry != NULL) {
+			koml_internal_sample(table->telemetry, handle->slot);
+		}
+		return koml_internal_symbol_at(table, handle->slot);
+	}
+
+	/* overlays share their base's seed, so the stored hash serves the rest of the chain */
+	return (table->base != NULL) ? koml_table_symbol_hash(table->base, handle->name, handle->name_length, handle->hash) : NULL;
+}
+
+koml_table_t * koml_table_retain(koml_table_t * table) {
+	__atomic_add_fetch(&table->refcount, 1, __ATOMIC_RELAXED);
+	return table;
+}
+
+int koml_table_overlay(koml_table_t * out_table, koml_table_t * base, char * buffer, unsigned long long int buffer_length) {
+	koml_load_options_t options = {
+		.flags = 0,
+		.base = base,
+	};
+
+	return koml_table_load_ex(out_table, buffer, buffer_length, &options);
+}
+
+static void koml_internal_symbol_free(koml_symbol_t * symbol) {
+	free(symbol->name);
+
+	if (symbol->type == KOML_TYPE_STRING) {
+		free(symbol->data.string);
+	} else if (symbol->type == KOML_TYPE_ARRAY) {
+		if (symbol->data.array.type == KOML_TYPE_STRING && symbol->data.array.elements.string != NULL) {
+			for (unsigned long long int i = 0; i < symbol->data.array.length; ++i) {
+				free(symbol->data.array.elements.string[i]);
+			}
+		}
+		free(symbol->data.array.elements.voidptr);
+		free(symbol->data.array.strides);
+		free(symbol->data.array.shape);
+	}
+}
+
+int koml_table_destroy(koml_table_t * table) {
+	if (table->refcount > 1 && __atomic_sub_fetch(&table->refcount, 1, __ATOMIC_ACQ_REL) > 0) {
+		return 0;
+	}
+
+	if (table->block != NULL) {
+		munmap(table->block, table->block_size);
+	} else if (table->symbols != NULL) {
+		for (unsigned long long int i = 0; i < table->length; ++i) {
+			koml_internal_symbol_free(&table->symbols[i]);
+		}
+		free(table->symbols);
+	}
+
+	if (table->block == NULL) {
+		free(table->hashes);
+		free(table->index);
+	}
+
+	if (table->lazy != NULL) {
+		free(table->lazy);
+	}
+
+	if (table->flags & KOML_TABLE_OWNS_SOURCE) {
+		free(table->source);
+	}
+
+	free(table->telemetry);
+
+	if (table->base != NULL) {
+		koml_table_destroy(table->base);
+	}
+
+	table->symbols = NULL;
+	table->hashes = NULL;
+	table->lazy = NULL;
+	table->index = NULL;
+	table->source = NULL;
+	table->base = NULL;
+	table->length = 0;
+	table->refcount = 0;
+	table->block = NULL;
+	table->block_size = 0;
+	table->telemetry = NULL;
+	table->generation = 0;
+
+	if (table->flags & KOML_TABLE_OWNS_SELF) {
+		free(table);
+		return 0;
+	}
+	table->flags = 0;
+
+	return 0;
+}
+
+typedef struct koml_freeze_entry {
+	char * name;
+	unsigned long long int section;
+	unsigned long long int slot;
+	unsigned long long int rank;
+} koml_freeze_entry_t;
+
+static int koml_internal_freeze_section_compare(const void * a, const void * b) {
+	const koml_freeze_entry_t * ea = a;
+	const koml_freeze_entry_t * eb = b;
+	unsigned long long int length = (ea->section < eb->section) ? ea->section : eb->section;
+
+	int diff = memcmp(ea->name, eb->name, length);
+	if (diff == 0) {
+		diff = (ea->section > eb->section) - (ea->section < eb->section);
+	}
+	if (diff == 0) {
+		diff = (ea->slot > eb->slot) - (ea->slot < eb->slot);
+	}
+
+	return diff;
+}
+
+static int koml_internal_freeze_rank_compare(const void * a, const void * b) {
+	const koml_freeze_entry_t * ea = a;
+	const koml_freeze_entry_t * eb = b;
+
+	if (ea->rank != eb->rank) {
+		return (ea->rank > eb->rank) - (ea->rank < eb->rank);
+	}
+	return (ea->slot > eb->slot) - (ea->slot < eb->slot);
+}
+
+static unsigned long long int koml_internal_align(unsigned long long int offset, unsigned long long int alignment) {
+	return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+/* strides, elements, name and string bytes of one symbol, laid out back to back */
+static unsigned long long int koml_internal_freeze_payload(koml_symbol_t * symbol) {
+	unsigned long long int size = 0;
+
+	if (symbol->type == KOML_TYPE_ARRAY) {
+		koml_array_t * array = &symbol->data.array;
+		size += array->length * (sizeof(unsigned long long int) + koml_internal_element_stride(array->type));
+		size += (array->shape != NULL) ? array->rank * sizeof(unsigned long long int) : 0;
+		if (array->type == KOML_TYPE_STRING) {
+			for (unsigned long long int i = 0; i < array->length; ++i) {
+				size += strlen(array->elements.string[i]) + 1;
+			}
+		}
+	}
+
+	size += strlen(symbol->name) + 1;
+	if (symbol->type == KOML_TYPE_STRING) {
+		size += strlen(symbol->data.string) + 1;
+	}
+
+	return koml_internal_align(size, 8);
+}
+
+static char * koml_internal_freeze_string(char ** cursor, char * string) {
+	unsigned long long int length = strlen(string) + 1;
+	char * copy = *cursor;
+
+	memcpy(copy, string, length);
+	*cursor += length;
+	return copy;
+}
+
+int koml_table_freeze(koml_table_t * table) {
+	if (table->block != NULL) {
+		return 0;
+	}
+
+	for (unsigned long long int i = 0; i < table->length; ++i) {
+		if (koml_internal_symbol_at(table, i) == NULL) {
+			return 2;
+		}
+	}
+
+	koml_freeze_entry_t * entries = malloc((table->length + 1) * sizeof(koml_freeze_entry_t));
+	if (entries == NULL) {
+		return 1;
+	}
+
+	/* sections stay in order of first appearance, symbols keep their order inside a section */
+	for (unsigned long long int i = 0; i < table->length; ++i) {
+		char * colon = strchr(table->symbols[i].name, ':');
+		entries[i].name = table->symbols[i].name;
+		entries[i].section = (colon != NULL) ? (unsigned long long int) (colon - entries[i].name) : 0;
+		entries[i].slot = i;
+	}
+	qsort(entries, table->length, sizeof(koml_freeze_entry_t), koml_internal_freeze_section_compare);
+	for (unsigned long long int i = 0; i < table->length; ++i) {
+		unsigned char same = i > 0 && entries[i].section == entries[i - 1].section && memcmp(entries[i].name, entries[i - 1].name, entries[i].section) == 0;
+		entries[i].rank = (same) ? entries[i - 1].rank : entries[i].slot;
+	}
+	qsort(entries, table->length, sizeof(koml_freeze_entry_t), koml_internal_freeze_rank_compare);
+
+	/* symbols, hashes and index first so that a lookup walks forward through the block, then each symbol's payload */
+	unsigned long long int capacity = koml_internal_index_capacity(table->length);
+	unsigned long long int hashes_offset = koml_internal_align(table->length * sizeof(koml_symbol_t), 64);
+	unsigned long long int index_offset = koml_internal_align(hashes_offset + table->length * sizeof(unsigned long long int), 64);
+	unsigned long long int size = koml_internal_align(index_offset + capacity * sizeof(unsigned long long int), 64);
+	unsigned long long int data_offset = size;
+	for (unsigned long long int i = 0; i < table->length; ++i) {
+		size += koml_internal_freeze_payload(&table->symbols[i]);
+	}
+
+	char * block = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (block == MAP_FAILED) {
+		free(entries);
+		return 1;
+	}
+
+	koml_table_t frozen = *table;
+	frozen.symbols = (koml_symbol_t *) block;
+	frozen.hashes = (unsigned long long int *) (block + hashes_offset);
+	frozen.index = (unsigned long long int *) (block + index_offset);
+	frozen.index_mask = capacity - 1;
+
+	char * cursor = block + data_offset;
+	for (unsigned long long int i = 0; i < table->length; ++i) {
+		koml_symbol_t * source = &table->symbols[entries[i].slot];
+		koml_symbol_t * symbol = &frozen.symbols[i];
+		char * start = cursor;
+
+		*symbol = *source;
+		frozen.hashes[i] = table->hashes[entries[i].slot];
+
+		if (symbol->type == KOML_TYPE_ARRAY) {
+			koml_array_t * array = &symbol->data.array;
+			unsigned long long int stride = koml_internal_element_stride(array->type);
+
+			array->strides = (unsigned long long int *) cursor;
+			memcpy(cursor, source->data.array.strides, array->length * sizeof(unsigned long long int));
+			cursor += array->length * sizeof(unsigned long long int);
+
+			if (array->shape != NULL) {
+				array->shape = (unsigned long long int *) cursor;
+				memcpy(cursor, source->data.array.shape, array->rank * sizeof(unsigned long long int));
+				cursor += array->rank * sizeof(unsigned long long int);
+			}
+
+			array->elements.voidptr = cursor;
+			memcpy(cursor, source->data.array.elements.voidptr, array->length * stride);
+			cursor += array->length * stride;
+		}
+
+		symbol->name = koml_internal_freeze_string(&cursor, source->name);
+		if (symbol->type == KOML_TYPE_STRING) {
+			symbol->data.string = koml_internal_freeze_string(&cursor, source->data.string);
+		} else if (symbol->type == KOML_TYPE_ARRAY && symbol->data.array.type == KOML_TYPE_STRING) {
+			for (unsigned long long int n = 0; n < symbol->data.array.length; ++n) {
+				symbol->data.array.elements.string[n] = koml_internal_freeze_string(&cursor, source->data.array.elements.string[n]);
+			}
+		}
+
+		cursor = start + koml_internal_freeze_payload(source);
+	}
+	koml_internal_index_fill(&frozen, frozen.index, capacity);
+
+	/* sampled counts follow their symbols to the new slots */
+	koml_telemetry_t * telemetry = table->telemetry;
+	if (telemetry != NULL) {
+		for (unsigned long long int i = 0; i < table->length; ++i) {
+			entries[i].rank = (entries[i].slot < telemetry->length) ? telemetry->counts[entries[i].slot] : 0;
+		}
+		for (unsigned long long int i = 0; i < telemetry->length; ++i) {
+			telemetry->counts[i] = (i < table->length) ? entries[i].rank : 0;
+		}
+	}
+	free(entries);
+
+	for (unsigned long long int i = 0; i < table->length; ++i) {
+		koml_internal_symbol_free(&table->symbols[i]);
+	}
+	free(table->symbols);
+	free(table->hashes);
+	free(table->lazy);
+	free(table->index);
+	if (table->flags & KOML_TABLE_OWNS_SOURCE) {
+		free(table->source);
+	}
+
+	frozen.lazy = NULL;
+	frozen.source = NULL;
+	frozen.flags &= ~KOML_TABLE_OWNS_SOURCE;
+	frozen.block = block;
+	frozen.block_size = size;
+	frozen.generation = __atomic_add_fetch(&koml_generation_counter, 1, __ATOMIC_RELAXED);
+	*table = frozen;
+
+	mprotect(block, size, PROT_READ);
+	return 0;
+}
+
+int koml_table_telemetry(koml_table_t * table, unsigned int rate) {
+	free(table->telemetry);
+	table->telemetry = NULL;
+
+	if (rate == 0) {
+		return 0;
+	}
+
+	koml_telemetry_t * telemetry = calloc(1, sizeof(koml_telemetry_t) + table->length * sizeof(unsigned long long int));
+	if (telemetry == NULL) {
+		return 1;
+	}
+
+	telemetry->rate = rate;
+	telemetry->length = table->length;
+	table->telemetry = telemetry;
+	return 0;
+}
+
+typedef struct koml_hot_entry {
+	unsigned long long int count;
+	unsigned long long int slot;
+} koml_hot_entry_t;
+
+/* hottest first, ties in slot order */
+static int koml_internal_hot_compare(const void * a, const void * b) {
+	const koml_hot_entry_t * ea = a;
+	const koml_hot_entry_t * eb = b;
+
+	if (ea->count != eb->count) {
+		return (ea->count < eb->count) - (ea->count > eb->count);
+	}
+
+	return (ea->slot > eb->slot) - (ea->slot < eb->slot);
+}
+
+/* sampled slots sorted hottest first; NULL on allocation failure */
+static koml_hot_entry_t * koml_internal_hot_entries(koml_table_t * table, unsigned long long int * out_count) {
+	koml_telemetry_t * telemetry = table->telemetry;
+	unsigned long long int length = (telemetry->length < table->length) ? telemetry->length : table->length;
+
+	koml_hot_entry_t * entries = malloc((length + 1) * sizeof(koml_hot_entry_t));
+	if (entries == NULL) {
+		return NULL;
+	}
+
+	unsigned long long int count = 0;
+	for (unsigned long long int i = 0; i < length; ++i) {
+		unsigned long long int samples = __atomic_load_n(&telemetry->counts[i], __ATOMIC_RELAXED);
+		if (samples > 0) {
+			entries[count].count = samples;
+			entries[count].slot = i;
+			++count;
+		}
+	}
+	qsort(entries, count, sizeof(koml_hot_entry_t), koml_internal_hot_compare);
+
+	*out_count = count;
+	return entries;
+}
+
+unsigned long long int koml_table_hot_keys(koml_table_t * table, koml_hot_key_t * out, unsigned long long int capacity) {
+	if (table->telemetry == NULL) {
+		return 0;
+	}
+
+	unsigned long long int count = 0;
+	koml_hot_entry_t * entries = koml_internal_hot_entries(table, &count);
+	if (entries == NULL) {
+		return 0;
+	}
+
+	if (count > capacity) {
+		count = capacity;
+	}
+
+	for (unsigned long long int i = 0; i < count; ++i) {
+		out[i].symbol = &table->symbols[entries[i].slot];
+		out[i].count = entries[i].count * table->telemetry->rate;
+	}
+
+	free(entries);
+	return count;
+}
+
+/* hot symbols go first and are inserted into the index first, so each sits in its home bucket and the hot set shares the leading cache lines */
+int koml_table_relayout(koml_table_t * table, unsigned long long int count) {
+	koml_telemetry_t * telemetry = table->telemetry;
+	if (telemetry == NULL) {
+		return 2;
+	}
+
+	unsigned long long int hot = 0;
+	koml_hot_entry_t * entries = koml_internal_hot_entries(table, &hot);
+	if (entries == NULL) {
+		return 1;
+	}
+
+	if (count == 0 || count > hot) {
+		count = hot;
+	}
+
+	unsigned long long int length = table->length;
+	unsigned long long int * order = malloc((length + 1) * sizeof(unsigned long long int));
+	unsigned char * taken = calloc(length + 1, 1);
+	koml_symbol_t * symbols = malloc((length + 1) * sizeof(koml_symbol_t));
+	unsigned long long int * hashes = malloc((length + 1) * sizeof(unsigned long long int));
+	struct koml_lazy * lazy = (table->lazy != NULL) ? malloc((length + 1) * sizeof(struct koml_lazy)) : NULL;
+	if (order == NULL || taken == NULL || symbols == NULL || hashes == NULL || (table->lazy != NULL && lazy == NULL)) {
+		free(entries);
+		free(order);
+		free(taken);
+		free(symbols);
+		free(hashes);
+		free(lazy);
+		return 1;
+	}
+
+	/* order[i] is the old slot that moves to slot i; the rest keep their relative order so duplicates still resolve to the first definition */
+	for (unsigned long long int i = 0; i < count; ++i) {
+		order[i] = entries[i].slot;
+		taken[entries[i].slot] = 1;
+	}
+	for (unsigned long long int i = 0, next = count; i < length; ++i) {
+		if (!taken[i]) {
+			order[next++] = i;
+		}
+	}
+	free(entries);
+	free(taken);
+
+	for (unsigned long long int i = 0; i < length; ++i) {
+		symbols[i] = table->symbols[order[i]];
+		hashes[i] = table->hashes[order[i]];
+		if (lazy != NULL) {
+			lazy[i] = table->lazy[order[i]];
+		}
+	}
+
+	/* a private frozen block can be unprotected for the rewrite; an attached shared image maps a read-only segment and cannot */
+	if (table->block != NULL && mprotect(table->block, table->block_size, PROT_READ | PROT_WRITE) != 0) {
+		free(order);
+		free(symbols);
+		free(hashes);
+		free(lazy);
+		return 1;
+	}
+
+	memcpy(table->symbols, symbols, length * sizeof(koml_symbol_t));
+	memcpy(table->hashes, hashes, length * sizeof(unsigned long long int));
+	if (lazy != NULL) {
+		memcpy(table->lazy, lazy, length * sizeof(struct koml_lazy));
+	}
+	if (table->index != NULL) {
+		memset(table->index, 0, (table->index_mask + 1) * sizeof(unsigned long long int));
+		koml_internal_index_fill(table, table->index, table->index_mask + 1);
+	}
+
+	int ret = 0;
+	if (table->block != NULL && mprotect(table->block, table->block_size, PROT_READ) != 0) {
+		ret = 1;
+	}
+	table->generation = __atomic_add_fetch(&koml_generation_counter, 1, __ATOMIC_RELAXED);
+
+	/* counts follow their symbols; the hashes scratch is free again */
+	unsigned long long int * counts = hashes;
+	for (unsigned long long int i = 0; i < length; ++i) {
+		counts[i] = (order[i] < telemetry->length) ? telemetry->counts[order[i]] : 0;
+	}
+	for (unsigned long long int i = 0; i < telemetry->length; ++i) {
+		telemetry->counts[i] = (i < length) ? counts[i] : 0;
+	}
+
+	free(order);
+	free(symbols);
+	free(hashes);
+	free(lazy);
+	return ret;
+}
+
+/* symbols a lookup through the table can actually reach */
+static koml_symbol_t ** koml_internal_visible(koml_table_t * table, unsigned long long int * out_count) {
+	unsigned long long int capacity = 0;
+	for (koml_table_t * layer = table; layer != NULL; layer = layer->base) {
+		capacity += layer->length;
+	}
+
+	koml_symbol_t ** visible = malloc((capacity + 1) * sizeof(koml_symbol_t *));
+	if (visible == NULL) {
+		return NULL;
+	}
+
+	unsigned long long int count = 0;
+	for (koml_table_t * layer = table; layer != NULL; layer = layer->base) {
+		for (unsigned long long int i = 0; i < layer->length; ++i) {
+			if (koml_internal_reachable(table, layer, i)) {
+				koml_symbol_t * symbol = koml_internal_symbol_at(layer, i);
+				if (symbol != NULL) {
+					visible[count++] = symbol;
+				}
+			}
+		}
+	}
+
+	*out_count = count;
+	return visible;
+}
+
+static unsigned char koml_internal_element_equal(koml_array_t * a, koml_array_t * b, unsigned long long int i) {
+	switch (a->type) {
+		case KOML_TYPE_INT:
+			return a->elements.i32[i] == b->elements.i32[i];
+		case KOML_TYPE_FLOAT:
+			return memcmp(&a->elements.f32[i], &b->elements.f32[i], sizeof(float)) == 0;
+		case KOML_TYPE_STRING:
+			return strcmp(a->elements.string[i], b->elements.string[i]) == 0;
+		case KOML_TYPE_BOOLEAN:
+			return a->elements.boolean[i] == b->elements.boolean[i];
+		default:
+			return 0;
+	}
+}
+
+static unsigned char koml_internal_same_type(koml_symbol_t * a, koml_symbol_t * b) {
+	return a->type == b->type && (a->type != KOML_TYPE_ARRAY || (a->data.array.type == b->data.array.type && a->data.array.rank == b->data.array.rank));
+}
+
+static unsigned char koml_internal_same_shape(koml_array_t * a, koml_array_t * b) {
+	return a->length == b->length && (a->shape == NULL || b->shape == NULL || memcmp(a->shape, b->shape, a->rank * sizeof(unsigned long long int)) == 0);
+}
+
+static unsigned char koml_internal_symbol_equal(koml_symbol_t * a, koml_symbol_t * b) {
+	if (a == NULL || b == NULL) {
+		return a == b;
+	}
+
+	if (!koml_internal_same_type(a, b)) {
+		return 0;
+	}
+
+	switch (a->type) {
+		case KOML_TYPE_INT:
+			return a->data.i32 == b->data.i32;
+		case KOML_TYPE_FLOAT:
+			return memcmp(&a->data.f32, &b->data.f32, sizeof(float)) == 0;
+		case KOML_TYPE_STRING:
+			return strcmp(a->data.string, b->data.string) == 0;
+		case KOML_TYPE_BOOLEAN:
+			return a->data.boolean == b->data.boolean;
+		case KOML_TYPE_ARRAY:
+			if (!koml_internal_same_shape(&a->data.array, &b->data.array)) {
+				return 0;
+			}
+			for (unsigned long long int i = 0; i < a->data.array.length; ++i) {
+				if (!koml_internal_element_equal(&a->data.array, &b->data.array, i)) {
+					return 0;
+				}
+			}
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static int koml_internal_diff_symbol(koml_symbol_t * a, koml_symbol_t * b, koml_diff_callback_t callback, void * user) {
+	if (!koml_internal_same_type(a, b)) {
+		return callback(user, KOML_DIFF_TYPE_CHANGED, a, b, 0);
+	}
+
+	if (a->type != KOML_TYPE_ARRAY) {
+		return koml_internal_symbol_equal(a, b) ? 0 : callback(user, KOML_DIFF_VALUE_CHANGED, a, b, 0);
+	}
+
+	koml_array_t * aa = &a->data.array;
+	koml_array_t * ba = &b->data.array;
+	/* element indices only line up between arrays of one shape */
+	if (aa->rank > 0 && !koml_internal_same_shape(aa, ba)) {
+		return callback(user, KOML_DIFF_VALUE_CHANGED, a, b, 0);
+	}
+
+	unsigned long long int common = (aa->length < ba->length) ? aa->length : ba->length;
+	int ret = 0;
+
+	for (unsigned long long int i = 0; ret == 0 && i < common; ++i) {
+		if (!koml_internal_element_equal(aa, ba, i)) {
+			ret = callback(user, KOML_DIFF_ELEMENT_CHANGED, a, b, i);
+		}
+	}
+
+	for (unsigned long long int i = common; ret == 0 && i < aa->length; ++i) {
+		ret = callback(user, KOML_DIFF_ELEMENT_REMOVED, a, b, i);
+	}
+
+	for (unsigned long long int i = common; ret == 0 && i < ba->length; ++i) {
+		ret = callback(user, KOML_DIFF_ELEMENT_ADDED, a, b, i);
+	}
+
+	return ret;
+}
+
+int koml_table_diff(koml_table_t * a, koml_table_t * b, koml_diff_callback_t callback, void * user) {
+	if (a == NULL || b == NULL || callback == NULL) {
+		return -1;
+	}
+
+	unsigned long long int a_count = 0;
+	unsigned long long int b_count = 0;
+	koml_symbol_t ** a_visible = koml_internal_visible(a, &a_count);
+	koml_symbol_t ** b_visible = koml_internal_visible(b, &b_count);
+	int ret = 0;
+
+	if (a_visible == NULL || b_visible == NULL) {
+		ret = -1;
+	}
+
+	for (unsigned long long int i = 0; ret == 0 && i < a_count; ++i) {
+		koml_symbol_t * other = koml_internal_symbol_unsampled(b, a_visible[i]->name);
+		if (other == NULL) {
+			ret = callback(user, KOML_DIFF_REMOVED, a_visible[i], NULL, 0);
+		} else {
+			ret = koml_internal_diff_symbol(a_visible[i], other, callback, user);
+		}
+	}
+
+	for (unsigned long long int i = 0; ret == 0 && i < b_count; ++i) {
+		if (koml_internal_symbol_unsampled(a, b_visible[i]->name) == NULL) {
+			ret = callback(user, KOML_DIFF_ADDED, NULL, b_visible[i], 0);
+		}
+	}
+
+	free(a_visible);
+	free(b_visible);
+	return ret;
+}
+
+static int koml_internal_table_append(koml_table_t * table, koml_symbol_t * source) {
+	if (koml_table_alloc_new(table) != 0) {
+		return 1;
+	}
+
+	koml_symbol_t * symbol = &table->symbols[table->length - 1];
+	unsigned long long int name_length = strlen(source->name);
+	symbol->name = malloc(name_length + 1);
+	if (symbol->name == NULL) {
+		return 1;
+	}
+
+	memcpy(symbol->name, source->name, name_length + 1);
+	symbol->type = source->type;
+	symbol->stride = source->stride;
+	symbol->data.array.type = (source->type == KOML_TYPE_ARRAY) ? source->data.array.type : KOML_TYPE_UNKNOWN;
+	symbol->data.array.rank = (source->type == KOML_TYPE_ARRAY) ? source->data.array.rank : 0;
+	table->hashes[table->length - 1] = koml_hash(symbol->name, name_length, table->seed);
+
+	return (koml_internal_copy_reference(symbol, source) != 0) ? 1 : 0;
+}
+
+int koml_table_merge(koml_table_t * out_table, koml_table_t * base, koml_table_t * ours, koml_table_t * theirs, koml_merge_callback_t conflict, void * user) {
+	if (out_table == NULL || base == NULL || ours == NULL || theirs == NULL) {
+		return 1;
+	}
+
+	koml_internal_table_init(out_table);
+
+	unsigned long long int ours_count = 0;
+	unsigned long long int theirs_count = 0;
+	koml_symbol_t ** ours_visible = koml_internal_visible(ours, &ours_count);
+	koml_symbol_t ** theirs_visible = koml_internal_visible(theirs, &theirs_count);
+	int ret = (ours_visible == NULL || theirs_visible == NULL) ? 1 : 0;
+	unsigned char unresolved = 0;
+
+	for (unsigned long long int i = 0; ret == 0 && i < ours_count + theirs_count; ++i) {
+		koml_symbol_t * o = NULL;
+		koml_symbol_t * t = NULL;
+		char * name = NULL;
+
+		if (i < ours_count) {
+			o = ours_visible[i];
+			name = o->name;
+			t = koml_internal_symbol_unsampled(theirs, name);
+		} else {
+			t = theirs_visible[i - ours_count];
+			name = t->name;
+			if (koml_internal_symbol_unsampled(ours, name) != NULL) {
+				continue;
+			}
+		}
+
+		koml_symbol_t * b = koml_internal_symbol_unsampled(base, name);
+		koml_symbol_t * keep = NULL;
+		if (koml_internal_symbol_equal(o, t) || koml_internal_symbol_equal(b, t)) {
+			keep = o;
+		} else if (koml_internal_symbol_equal(b, o)) {
+			keep = t;
+		} else if (conflict != NULL) {
+			keep = conflict(user, b, o, t);
+		} else {
+			keep = o;
+			unresolved = 1;
+		}
+
+		if (keep != NULL) {
+			ret = koml_internal_table_append(out_table, keep);
+		}
+	}
+
+	free(ours_visible);
+	free(theirs_visible);
+
+	if (ret == 0 && koml_internal_index_build(out_table) != 0) {
+		ret = 1;
+	}
+
+	if (ret != 0) {
+		koml_table_destroy(out_table);
+		return ret;
+	}
+
+	return (unresolved) ? 2 : 0;
+}
+
+/* one compiled rule: the entry with its key measured and hashed up front */
+typedef struct koml_schema_rule {
+	koml_schema_entry_t entry;
+	unsigned long long int name_length;
+	unsigned long long int hash;
+} koml_schema_rule_t;
+
+struct koml_schema {
+	koml_schema_rule_t * rules;
+	unsigned long long int count;
+	unsigned long long int seed;
+	/* every key, back to back; rule names point in here */
+	char * names;
+};
+
+int koml_schema_compile(koml_schema_t ** out_schema, koml_schema_entry_t * entries, unsigned long long int count, unsigned long long int seed) {
+	*out_schema = NULL;
+
+	unsigned long long int names_size = 0;
+	for (unsigned long long int i = 0; i < count; ++i) {
+		koml_schema_entry_t * entry = &entries[i];
+		if (entry->name == NULL || entry->type <= KOML_TYPE_UNKNOWN || entry->type > KOML_TYPE_ARRAY) {
+			return 2;
+		}
+		/* shaped arrays have rank 2 or more, so no symbol has rank 1 */
+		if (entry->type == KOML_TYPE_ARRAY && (entry->array_type <= KOML_TYPE_UNKNOWN || entry->array_type >= KOML_TYPE_ARRAY || entry->rank == 1 || entry->rank > KOML_MAX_RANK
+			|| (entry->rank > 0 && entry->array_type != KOML_TYPE_INT && entry->array_type != KOML_TYPE_FLOAT))) {
+			return 2;
+		}
+		names_size += strlen(entry->name) + 1;
+	}
+
+	koml_schema_t * schema = malloc(sizeof(koml_schema_t));
+	koml_schema_rule_t * rules = malloc((count + 1) * sizeof(koml_schema_rule_t));
+	char * names = malloc(names_size + 1);
+	if (schema == NULL || rules == NULL || names == NULL) {
+		free(schema);
+		free(rules);
+		free(names);
+		return 1;
+	}
+
+	char * name = names;
+	for (unsigned long long int i = 0; i < count; ++i) {
+		koml_schema_rule_t * rule = &rules[i];
+		rule->entry = entries[i];
+		rule->name_length = strlen(entries[i].name);
+		memcpy(name, entries[i].name, rule->name_length + 1);
+		rule->entry.name = name;
+		rule->hash = koml_hash(name, rule->name_length, seed);
+		name += rule->name_length + 1;
+	}
+
+	schema->rules = rules;
+	schema->count = count;
+	schema->seed = seed;
+	schema->names = names;
+	*out_schema = schema;
+	return 0;
+}
+
+/* the stored hash only serves tables loaded with the schema's seed */
+static koml_symbol_t * koml_internal_schema_find(koml_schema_t * schema, koml_table_t * table, koml_schema_rule_t * rule, int * out_error) {
+	return koml_internal_lookup(table, rule->entry.name, rule->name_length, schema->seed, rule->hash, 0, out_error);
+}
+
+static unsigned char koml_internal_schema_in_range(koml_schema_entry_t * entry, koml_type_enum type, void * value) {
+	double number = (type == KOML_TYPE_INT) ? *(int *) value : *(float *) value;
+	return number >= entry->min && number <= entry->max;
+}
+
+/* the violation for symbol against rule (0 for none); out_element is the first array element out of range */
+static koml_schema_violation_enum koml_internal_schema_rule(koml_schema_rule_t * rule, koml_symbol_t * symbol, unsigned long long int * out_element) {
+	koml_schema_entry_t * entry = &rule->entry;
+	*out_element = 0;
+
+	if (symbol->type != entry->type) {
+		return KOML_SCHEMA_WRONG_TYPE;
+	}
+
+	if (symbol->type == KOML_TYPE_STRING) {
+		unsigned long long int length = strlen(symbol->data.string);
+		return ((entry->flags & KOML_SCHEMA_CHECK_LENGTH) && (length < entry->min_length || length > entry->max_length)) ? KOML_SCHEMA_BAD_LENGTH : 0;
+	}
+
+	if (symbol->type != KOML_TYPE_ARRAY) {
+		unsigned char numeric = symbol->type == KOML_TYPE_INT || symbol->type == KOML_TYPE_FLOAT;
+		return (numeric && (entry->flags & KOML_SCHEMA_CHECK_RANGE) && !koml_internal_schema_in_range(entry, symbol->type, &symbol->data)) ? KOML_SCHEMA_OUT_OF_RANGE : 0;
+	}
+
+	koml_array_t * array = &symbol->data.array;
+	if (array->type != entry->array_type || array->rank != entry->rank) {
+		return KOML_SCHEMA_WRONG_TYPE;
+	}
+	if ((entry->flags & KOML_SCHEMA_CHECK_LENGTH) && (array->length < entry->min_length || array->length > entry->max_length)) {
+		return KOML_SCHEMA_BAD_LENGTH;
+	}
+
+	if ((entry->flags & KOML_SCHEMA_CHECK_RANGE) && (array->type == KOML_TYPE_INT || array->type == KOML_TYPE_FLOAT)) {
+		unsigned long long int stride = koml_internal_element_stride(array->type);
+		for (unsigned long long int i = 0; i < array->length; ++i) {
+			if (!koml_internal_schema_in_range(entry, array->type, (char *) array->elements.voidptr + i * stride)) {
+				*out_element = i;
+				return KOML_SCHEMA_OUT_OF_RANGE;
+			}
+		}
+	}
+
+	return 0;
+}
+
+unsigned long long int koml_schema_check(koml_schema_t * schema, koml_table_t * table, koml_schema_error_t * errors, unsigned long long int capacity) {
+	unsigned long long int violations = 0;
+
+	for (unsigned long long int i = 0; i < schema->count; ++i) {
+		koml_schema_rule_t * rule = &schema->rules[i];
+		int error = 0;
+		koml_symbol_t * symbol = koml_internal_schema_find(schema, table, rule, &error);
+		unsigned long long int element = 0;
+		koml_schema_violation_enum kind = 0;
+
+		if (symbol != NULL) {
+			kind = koml_internal_schema_rule(rule, symbol, &element);
+		} else if (error != 0) {
+			kind = KOML_SCHEMA_BAD_VALUE;
+		} else if (!(rule->entry.flags & KOML_SCHEMA_OPTIONAL)) {
+			kind = KOML_SCHEMA_MISSING;
+		}
+
+		if (kind == 0) {
+			continue;
+		}
+
+		if (violations < capacity) {
+			errors[violations].kind = kind;
+			errors[violations].entry = i;
+			errors[violations].name = rule->entry.name;
+			errors[violations].element = element;
+		}
+		++violations;
+	}
+
+	return violations;
+}
+
+int koml_schema_destroy(koml_schema_t * schema) {
+	if (schema != NULL) {
+		free(schema->rules);
+		free(schema->names);
+		free(schema);
+	}
+	return 0;
+}
+
+typedef struct koml_validate_entry {
+	unsigned long long int hash;
+	unsigned long long int section;
+	unsigned long long int section_length;
+	unsigned long long int name;
+	unsigned long long int name_length;
+	koml_type_enum type;
+	koml_type_enum array_type;
+	unsigned int rank;
+	/* index + 1 of the entry's reference, 0 for a plain value; in the padding, so the entry stays 56 bytes */
+	unsigned int reference;
+} koml_validate_entry_t;
+
+/* koml_reference_t for the scratch index: the referring entry and, once found, the one it names */
+typedef struct koml_validate_reference {
+	unsigned long long int entry;
+	unsigned long long int name;
+	unsigned long long int name_length;
+	koml_validate_entry_t * target;
+	unsigned char state;
+} koml_validate_reference_t;
+
+typedef struct koml_validate_state {
+	char * buffer;
+	koml_validate_entry_t * entries;
+	unsigned long long int mask;
+	unsigned long long int seed;
+	koml_validate_reference_t * references;
+	unsigned long long int reference_count;
+	unsigned long long int * path;
+	koml_error_t * error;
+} koml_validate_state_t;
+
+static int koml_internal_fail(koml_validate_state_t * state, unsigned long long int offset, int code, char * message) {
+	if (state->error != NULL) {
+		koml_internal_position(state->buffer, offset, &state->error->line, &state->error->column);
+		++state->error->line;
+		++state->error->column;
+		state->error->code = code;
+		state->error->message = message;
+	}
+
+	return code;
+}
+
+/* keyed on the part after the last ':' and the full length, so `section` + `name` hash like "@section:name" without being joined */
+static unsigned long long int koml_internal_hash_key(char * name, unsigned long long int name_length, unsigned long long int full_length, unsigned long long int seed) {
+	unsigned long long int key = name_length;
+	while (key > 0 && name[key - 1] != ':') {
+		--key;
+	}
+
+	return koml_hash(&name[key], name_length - key, seed ^ full_length);
+}
+
+static koml_validate_entry_t * koml_internal_validate_find(koml_validate_state_t * state, char * name, unsigned long long int name_length, unsigned long long int hash) {
+	for (unsigned long long int i = hash & state->mask; state->entries[i].type != KOML_TYPE_UNKNOWN; i = (i + 1) & state->mask) {
+		koml_validate_entry_t * entry = &state->entries[i];
+		if (entry->hash != hash) {
+			continue;
+		}
+
+		if (entry->section_length == 0) {
+			if (entry->name_length == name_length && memcmp(&state->buffer[entry->name], name, name_length) == 0) {
+				return entry;
+			}
+		} else if (entry->section_length + 1 + entry->name_length == name_length
+				&& memcmp(&state->buffer[entry->section], name, entry->section_length) == 0
+				&& name[entry->section_length] == ':'
+				&& memcmp(&state->buffer[entry->name], &name[entry->section_length + 1], entry->name_length) == 0) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/* a reference is only recorded here; it is checked once every name is known */
+static int koml_internal_validate_value(koml_validate_state_t * state, koml_lexer_t * lexer, koml_statement_t * statement) {
+	koml_token_t reference;
+	unsigned long long int offset = lexer->i;
+	char * message = NULL;
+
+	int ret = koml_internal_value(lexer, statement->type, statement->array_type, statement->rank, NULL, &reference, &offset, &message);
+	if (ret != 0) {
+		return koml_internal_fail(state, offset, ret, message);
+	}
+
+	if (reference.kind == KOML_TOKEN_AT) {
+		state->references[state->reference_count++] = (koml_validate_reference_t) {
+			.name = reference.start,
+			.name_length = reference.length,
+		};
+	}
+
+	return 0;
+}
+
+static unsigned char koml_internal_validate_compatible(koml_validate_entry_t * entry, koml_validate_entry_t * target) {
+	koml_type_enum have = (entry->type == KOML_TYPE_ARRAY) ? target->array_type : target->type;
+	koml_type_enum want = (entry->type == KOML_TYPE_ARRAY) ? entry->array_type : entry->type;
+	unsigned char numeric = (want == KOML_TYPE_INT || want == KOML_TYPE_FLOAT) && (have == KOML_TYPE_INT || have == KOML_TYPE_FLOAT);
+	return (entry->type == KOML_TYPE_ARRAY) == (target->type == KOML_TYPE_ARRAY) && (have == want || numeric) && entry->rank == target->rank;
+}
+
+static koml_validate_entry_t * koml_internal_validate_target(koml_validate_state_t * state, koml_validate_reference_t * reference) {
+	char * name = &state->buffer[reference->name];
+	koml_validate_entry_t * target = koml_internal_validate_find(state, name, reference->name_length, koml_internal_hash_key(name, reference->name_length, reference->name_length, state->seed));
+	return (target == &state->entries[reference->entry]) ? NULL : target;
+}
+
+/* koml_internal_resolve on declared types: the same walk in the same order, so the first error matches koml_table_load's */
+static int koml_internal_validate_references(koml_validate_state_t * state) {
+	for (unsigned long long int i = 0; i < state->reference_count; ++i) {
+		unsigned long long int depth = 0;
+		unsigned long long int at = i;
+		while (state->references[at].state == KOML_REFERENCE_PENDING) {
+			koml_validate_reference_t * reference = &state->references[at];
+			reference->state = KOML_REFERENCE_VISITING;
+			state->path[depth++] = at;
+
+			reference->target = koml_internal_validate_target(state, reference);
+			if (reference->target == NULL) {
+				return koml_internal_fail(state, reference->name - 1, 17, "Variable reference to undefined symbol");
+			}
+
+			if (reference->target->reference == 0) {
+				break;
+			}
+			at = reference->target->reference - 1;
+			if (state->references[at].state == KOML_REFERENCE_VISITING) {
+				return koml_internal_fail(state, reference->name - 1, 23, "Circular variable reference");
+			}
+		}
+
+		if (state->references[at].state == KOML_REFERENCE_INVALID) {
+			return koml_internal_fail(state, state->references[at].name - 1, 18, "Invalid type of variable reference");
+		}
+
+		while (depth > 0) {
+			koml_validate_reference_t * reference = &state->references[state->path[--depth]];
+			if (!koml_internal_validate_compatible(&state->entries[reference->entry], reference->target)) {
+				return koml_internal_fail(state, reference->name - 1, 18, "Invalid type of variable reference");
+			}
+			reference->state = KOML_REFERENCE_RESOLVED;
+		}
+	}
+
+	return 0;
+}
+
+int koml_validate(char * buffer, unsigned long long int buffer_length, koml_error_t * error) {
+	koml_validate_entry_t local[256];
+	koml_validate_reference_t local_references[128];
+	unsigned long long int local_path[128];
+	koml_validate_state_t state = {
+		.buffer = buffer,
+		.entries = local,
+		.mask = 255,
+		.seed = koml_internal_random_seed(),
+		.references = local_references,
+		.path = local_path,
+		.error = error,
+	};
+
+	if (error != NULL) {
+		error->code = 0;
+		error->line = 0;
+		error->column = 0;
+		error->message = NULL;
+	}
+
+	if (buffer == NULL || buffer_length == 0) {
+		return koml_internal_fail(&state, 0, 1, "Empty buffer");
+	}
+
+	/* every statement ends in ';', so this bounds the symbol count for the one scratch allocation */
+	unsigned long long int statements = 0;
+	for (char * p = buffer; (p = memchr(p, ';', buffer_length - (p - buffer))) != NULL; ++p) {
+		++statements;
+	}
+
+	/* and every reference starts with '@', so the references and the resolution path take one slot per '@' behind the index */
+	unsigned long long int ats = 0;
+	for (char * p = buffer; (p = memchr(p, '@', buffer_length - (p - buffer))) != NULL; ++p) {
+		++ats;
+	}
+	if (ats >= 0xffffffffULL) {
+		return koml_internal_fail(&state, 0, 1, "Too many variable references");
+	}
+
+	if (statements * 2 > sizeof(local) / sizeof(local[0])) {
+		unsigned long long int capacity = 512;
+		while (capacity < statements * 2) {
+			capacity <<= 1;
+		}
+
+		state.entries = malloc(capacity * sizeof(koml_validate_entry_t) + ats * (sizeof(koml_validate_reference_t) + sizeof(unsigned long long int)));
+		if (state.entries == NULL) {
+			return koml_internal_fail(&state, 0, 1, "Failed to allocate scratch index");
+		}
+		state.mask = capacity - 1;
+		state.references = (koml_validate_reference_t *) &state.entries[capacity];
+		state.path = (unsigned long long int *) &state.references[ats];
+	}
+	memset(state.entries, 0, (state.mask + 1) * sizeof(koml_validate_entry_t));
+
+	koml_lexer_t lexer = {
+		.buffer = buffer,
+		.i = 0,
+		.end = buffer_length,
+	};
+	koml_statement_t statement = {
+		.type = KOML_TYPE_UNKNOWN,
+	};
+	int ret = 0;
+
+	for (;;) {
+		unsigned long long int offset = 0;
+		char * message = NULL;
+		ret = koml_internal_statement(&lexer, &statement, &offset, &message);
+		if (ret != 0) {
+			koml_internal_fail(&state, offset, ret, message);
+			break;
+		}
+
+		if (statement.type == KOML_TYPE_UNKNOWN) {
+			break;
+		}
+
+		unsigned long long int references = state.reference_count;
+		ret = koml_internal_validate_value(&state, &lexer, &statement);
+		if (ret != 0) {
+			break;
+		}
+
+		unsigned long long int full_length = (statement.section_length > 0) ? statement.section_length + 1 + statement.name_length : statement.name_length;
+		unsigned long long int hash = koml_internal_hash_key(&buffer[statement.name], statement.name_length, full_length, state.seed);
+		unsigned long long int slot = hash & state.mask;
+		while (state.entries[slot].type != KOML_TYPE_UNKNOWN) {
+			slot = (slot + 1) & state.mask;
+		}
+		state.entries[slot] = (koml_validate_entry_t) {
+			.hash = hash,
+			.section = statement.section,
+			.section_length = statement.section_length,
+			.name = statement.name,
+			.name_length = statement.name_length,
+			.type = statement.type,
+			.array_type = statement.array_type,
+			.rank = statement.rank,
+			.reference = (state.reference_count > references) ? state.reference_count : 0,
+		};
+		if (state.reference_count > references) {
+			/* a target already defined as a plain value is final, so it is checked while its entry is still warm */
+			koml_validate_reference_t * reference = &state.references[references];
+			reference->entry = slot;
+			koml_validate_entry_t * target = koml_internal_validate_target(&state, reference);
+			if (target != NULL && target->reference == 0) {
+				reference->target = target;
+				reference->state = koml_internal_validate_compatible(&state.entries[slot], target) ? KOML_REFERENCE_RESOLVED : KOML_REFERENCE_INVALID;
+			}
+		}
+	}
+
+	if (ret == 0) {
+		ret = koml_internal_validate_references(&state);
+	}
+
+	if (state.entries != local) {
+		free(state.entries);
+	}
+
+	return ret;
+}
+
+/* nul-terminated, since error reporting walks lines up to the terminator */
+static int koml_internal_read_file(char * path, char ** out_buffer, unsigned long long int * out_length) {
+	FILE * fp = fopen(path, "rb");
+	if (fp == NULL) {
+		return 20;
+	}
+
+	fseek(fp, 0L, SEEK_END);
+	long length = ftell(fp);
+	fseek(fp, 0L, SEEK_SET);
+	if (length < 0) {
+		fclose(fp);
+		return 20;
+	}
+
+	char * buffer = malloc(length + 1);
+	if (buffer == NULL) {
+		fclose(fp);
+		return 1;
+	}
+	buffer[length] = '\0';
+
+	if (fread(buffer, 1, length, fp) != (unsigned long) length) {
+		free(buffer);
+		fclose(fp);
+		return 20;
+	}
+
+	fclose(fp);
+	*out_buffer = buffer;
+	*out_length = length;
+	return 0;
+}
+
+int koml_table_load_file(koml_table_t * out_table, char * path, koml_load_options_t * options) {
+	char * buffer = NULL;
+	unsigned long long int length = 0;
+
+	koml_internal_table_init(out_table);
+
+	int ret = koml_internal_read_file(path, &buffer, &length);
+	if (ret != 0) {
+		return ret;
+	}
+
+	ret = koml_table_load_ex(out_table, buffer, length, options);
+	if (options != NULL && (options->flags & KOML_LOAD_LAZY) && out_table->source == buffer) {
+		out_table->flags |= KOML_TABLE_OWNS_SOURCE;
+	} else {
+		free(buffer);
+	}
+
+	return ret;
+}
+
+/* a cached table: this header, the frozen block with pointers stored as offsets into it, then the source it was parsed from */
+typedef struct koml_image_header {
+	char magic[8];
+	/* differs between builds with another struct layout or byte order */
+	unsigned long long int layout;
+	unsigned long long int seed;
+	unsigned long long int length;
+	unsigned long long int index_mask;
+	unsigned long long int hashes_offset;
+	unsigned long long int index_offset;
+	unsigned long long int block_offset;
+	unsigned long long int block_size;
+	unsigned long long int source_offset;
+	unsigned long long int source_length;
+	/* KOML_LOAD_UTF8 when the source passed the utf-8 checks */
+	unsigned long long int checks;
+	/* block pointers are stored as if the block sat at this address; 0 (plain offsets) for cache images */
+	unsigned long long int address;
+} koml_image_header_t;
+
+#define KOML_IMAGE_MAGIC "KOMLIMG1"
+#define KOML_IMAGE_LAYOUT (sizeof(koml_symbol_t) | sizeof(koml_array_t) << 16 | (unsigned long long int) sizeof(void *) << 32 | 0x0104ULL << 48)
+
+static int koml_internal_rebase(void * field, uintptr_t from, uintptr_t to, unsigned long long int size, unsigned long long int * out_offset) {
+	uintptr_t pointer;
+	memcpy(&pointer, field, sizeof(pointer));
+
+	unsigned long long int offset = pointer - from;
+	if (offset > size) {
+		return 1;
+	}
+
+	/* from == to only checks the bounds, so it works on a read-only mapping */
+	if (from != to) {
+		pointer = to + offset;
+		memcpy(field, &pointer, sizeof(pointer));
+	}
+	if (out_offset != NULL) {
+		*out_offset = offset;
+	}
+
+	return 0;
+}
+
+/* moves every pointer of a frozen block held at image from base address from to base address to; fails on anything pointing outside size */
+static int koml_internal_image_rebase(char * image, unsigned long long int length, unsigned long long int size, uintptr_t from, uintptr_t to) {
+	koml_symbol_t * symbols = (koml_symbol_t *) image;
+
+	for (unsigned long long int i = 0; i < length; ++i) {
+		koml_symbol_t * symbol = &symbols[i];
+		if (koml_internal_rebase(&symbol->name, from, to, size, NULL) != 0) {
+			return 1;
+		}
+
+		if (symbol->type == KOML_TYPE_STRING) {
+			if (koml_internal_rebase(&symbol->data.string, from, to, size, NULL) != 0) {
+				return 1;
+			}
+		} else if (symbol->type == KOML_TYPE_ARRAY) {
+			koml_array_t * array = &symbol->data.array;
+			unsigned long long int offset = 0;
+			if (koml_internal_rebase(&array->strides, from, to, size, NULL) != 0 || koml_internal_rebase(&array->elements.voidptr, from, to, size, &offset) != 0) {
+				return 1;
+			}
+			if (array->shape != NULL && (array->rank > KOML_MAX_RANK || koml_internal_rebase(&array->shape, from, to, size, NULL) != 0)) {
+				return 1;
+			}
+
+			if (array->type == KOML_TYPE_STRING) {
+				if (array->length > (size - offset) / sizeof(char *)) {
+					return 1;
+				}
+
+				char * elements = image + offset;
+				for (unsigned long long int n = 0; n < array->length; ++n) {
+					if (koml_internal_rebase(elements + n * sizeof(char *), from, to, size, NULL) != 0) {
+						return 1;
+					}
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void koml_internal_cache_path(char * out, unsigned long long int capacity, char * directory, char * buffer, unsigned long long int buffer_length, koml_load_options_t * options) {
+	unsigned long long int key = koml_hash(buffer, buffer_length, 0);
+
+	if (options->flags & KOML_LOAD_SEED) {
+		snprintf(out, capacity, "%s/%016llx-%llx-%016llx.kimg", directory, key, buffer_length, options->seed);
+	} else {
+		snprintf(out, capacity, "%s/%016llx-%llx.kimg", directory, key, buffer_length);
+	}
+}
+
+/* structure of an image of size bytes; cache hits also check the source, seed and utf-8 checks */
+static unsigned char koml_internal_image_valid(koml_image_header_t * header, unsigned long long int size) {
+	return memcmp(header->magic, KOML_IMAGE_MAGIC, 8) == 0
+		&& header->layout == KOML_IMAGE_LAYOUT
+		&& header->block_offset >= sizeof(koml_image_header_t) && header->block_offset % 64 == 0
+		&& header->block_size <= size - header->block_offset
+		&& header->source_offset == header->block_offset + header->block_size
+		&& header->source_length == size - header->source_offset
+		&& header->length <= header->block_size / sizeof(koml_symbol_t)
+		&& ((header->index_mask + 1) & header->index_mask) == 0
+		&& header->hashes_offset <= header->block_size && header->length <= (header->block_size - header->hashes_offset) / sizeof(unsigned long long int)
+		&& header->index_offset <= header->block_size && header->index_mask < (header->block_size - header->index_offset) / sizeof(unsigned long long int);
+}
+
+/*
+ * maps an image read-only into out_table. when the block can be mapped at the address its pointers were stored for, the
+ * mapping is shared and never written, so every process attached to it shares its pages; otherwise it is rebased on a private copy
+ */
+static int koml_internal_image_map(koml_table_t * out_table, int fd, koml_image_header_t ** out_header) {
+	struct stat info;
+	koml_image_header_t peek;
+	if (fstat(fd, &info) != 0 || (unsigned long long int) info.st_size < sizeof(koml_image_header_t) || pread(fd, &peek, sizeof(peek), 0) != sizeof(peek)) {
+		return 1;
+	}
+
+	unsigned long long int size = info.st_size;
+	char * map = MAP_FAILED;
+	unsigned char shared = 0;
+	if (peek.address != 0 && peek.address > peek.block_offset && (peek.address - peek.block_offset) % sysconf(_SC_PAGESIZE) == 0) {
+		char * want = (char *) (uintptr_t) (peek.address - peek.block_offset);
+		map = mmap(want, size, PROT_READ, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+		/* kernels before 4.17 take the address as a hint only */
+		if (map != MAP_FAILED && map != want) {
+			munmap(map, size);
+			map = MAP_FAILED;
+		}
+		shared = (map != MAP_FAILED);
+	}
+
+	if (!shared) {
+		map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			return 1;
+		}
+	}
+
+	koml_image_header_t * header = (koml_image_header_t *) map;
+	char * block = map + header->block_offset;
+	if (!koml_internal_image_valid(header, size) || koml_internal_image_rebase(block, header->length, header->block_size, header->address, (uintptr_t) block) != 0) {
+		munmap(map, size);
+		return 1;
+	}
+
+	koml_internal_table_init(out_table);
+	out_table->symbols = (koml_symbol_t *) block;
+	out_table->hashes = (unsigned long long int *) (block + header->hashes_offset);
+	out_table->index = (unsigned long long int *) (block + header->index_offset);
+	out_table->index_mask = header->index_mask;
+	out_table->length = header->length;
+	out_table->seed = header->seed;
+	out_table->block = map;
+	out_table->block_size = size;
+
+	if (!shared) {
+		mprotect(map, size, PROT_READ);
+	}
+	if (out_header != NULL) {
+		*out_header = header;
+	}
+	return 0;
+}
+
+/* maps a cached image of buffer; any mismatch, including a different source behind the same key, is a miss */
+static int koml_internal_cache_map(koml_table_t * out_table, char * path, char * buffer, unsigned long long int buffer_length, koml_load_options_t * options) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return 1;
+	}
+
+	koml_image_header_t * header;
+	int ret = koml_internal_image_map(out_table, fd, &header);
+	close(fd);
+	if (ret != 0) {
+		return 1;
+	}
+
+	unsigned char valid = header->address == 0
+		&& (!(options->flags & KOML_LOAD_SEED) || header->seed == options->seed)
+		&& (options->flags & KOML_LOAD_UTF8 & ~header->checks) == 0
+		&& header->source_length == buffer_length
+		&& memcmp((char *) header + header->source_offset, buffer, buffer_length) == 0;
+	if (!valid) {
+		koml_table_destroy(out_table);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int koml_internal_write_all(int fd, char * data, unsigned long long int length) {
+	while (length > 0) {
+		ssize_t written = write(fd, data, length);
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (written <= 0) {
+			return 1;
+		}
+
+		data += written;
+		length -= written;
+	}
+
+	return 0;
+}
+
+/* header and frozen block of table, with the block's pointers stored for address; the source (if any) follows it in the file */
+static char * koml_internal_image_build(koml_table_t * table, uintptr_t address, unsigned long long int source_length, unsigned int checks, unsigned long long int * out_size) {
+	/* a cache-mapped table's block starts with its own image header */
+	char * start = (char *) table->symbols;
+	koml_image_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, KOML_IMAGE_MAGIC, 8);
+	header.layout = KOML_IMAGE_LAYOUT;
+	header.seed = table->seed;
+	header.length = table->length;
+	header.index_mask = table->index_mask;
+	header.hashes_offset = (char *) table->hashes - start;
+	header.index_offset = (char *) table->index - start;
+	header.block_offset = koml_internal_align(sizeof(header), 64);
+	header.block_size = table->block_size - (start - table->block);
+	header.source_offset = header.block_offset + header.block_size;
+	header.source_length = source_length;
+	header.checks = checks;
+	header.address = address;
+
+	char * image = malloc(header.block_offset + header.block_size);
+	if (image == NULL) {
+		return NULL;
+	}
+
+	memset(image, 0, header.block_offset);
+	memcpy(image, &header, sizeof(header));
+	memcpy(image + header.block_offset, start, header.block_size);
+	koml_internal_image_rebase(image + header.block_offset, table->length, header.block_size, (uintptr_t) start, address);
+
+	*out_size = header.block_offset + header.block_size;
+	return image;
+}
+
+/* written to a private temporary file and renamed over the final name, so readers only ever see complete images and racing writers just replace each other */
+static void koml_internal_cache_store(koml_table_t * table, char * directory, char * path, char * buffer, unsigned long long int buffer_length, unsigned int checks) {
+	unsigned long long int size = 0;
+	char * image = koml_internal_image_build(table, 0, buffer_length, checks, &size);
+	if (image == NULL) {
+		return;
+	}
+
+	unsigned long long int temporary_capacity = strlen(directory) + 32;
+	char * temporary = malloc(temporary_capacity);
+	if (temporary == NULL) {
+		free(image);
+		return;
+	}
+	snprintf(temporary, temporary_capacity, "%s/.kimg-XXXXXX", directory);
+
+	int fd = mkstemp(temporary);
+	if (fd >= 0) {
+		int ret = koml_internal_write_all(fd, image, size);
+		if (ret == 0) {
+			ret = koml_internal_write_all(fd, buffer, buffer_length);
+		}
+
+		if (close(fd) != 0 || ret != 0 || rename(temporary, path) != 0) {
+			unlink(temporary);
+		}
+	}
+
+	free(temporary);
+	free(image);
+}
+
+/* gives a frozen table a fresh random seed, so a seed stored in a shared cache image never stays in use by the processes sharing it */
+static int koml_internal_cache_reseed(koml_table_t * table) {
+	if (mprotect(table->block, table->block_size, PROT_READ | PROT_WRITE) != 0) {
+		return 1;
+	}
+
+	table->seed = koml_internal_random_seed();
+	for (unsigned long long int i = 0; i < table->length; ++i) {
+		table->hashes[i] = koml_hash(table->symbols[i].name, strlen(table->symbols[i].name), table->seed);
+	}
+	if (table->index != NULL) {
+		memset(table->index, 0, (table->index_mask + 1) * sizeof(unsigned long long int));
+		koml_internal_index_fill(table, table->index, table->index_mask + 1);
+	}
+
+	return (mprotect(table->block, table->block_size, PROT_READ) == 0) ? 0 : 1;
+}
+
+static int koml_internal_load_cached(koml_table_t * out_table, char * buffer, unsigned long long int buffer_length, koml_load_options_t * options) {
+	unsigned long long int path_capacity = strlen(options->cache) + 64;
+	char * path = malloc(path_capacity);
+	if (path == NULL) {
+		return 1;
+	}
+	koml_internal_cache_path(path, path_capacity, options->cache, buffer, buffer_length, options);
+
+	int ret = 0;
+	if (koml_internal_cache_map(out_table, path, buffer, buffer_length, options) != 0) {
+		/* a miss parses eagerly (the image needs every value) and hands back the same frozen table a hit would */
+		koml_load_options_t parse = *options;
+		parse.flags &= ~(KOML_LOAD_CACHE | KOML_LOAD_LAZY);
+
+		ret = koml_table_load_ex(out_table, buffer, buffer_length, &parse);
+		if (ret == 0) {
+			ret = koml_table_freeze(out_table);
+		}
+		if (ret == 0) {
+			koml_internal_cache_store(out_table, options->cache, path, buffer, buffer_length, options->flags & KOML_LOAD_UTF8);
+		}
+	}
+
+	/* the image records the seed it was stored with; unless the caller chose one, the table moves off it */
+	if (ret == 0 && !(options->flags & KOML_LOAD_SEED)) {
+		ret = koml_internal_cache_reseed(out_table);
+	}
+
+	free(path);
+	return ret;
+}
+
+/* the channel segment: the newest published generation and the last one handed out to a publisher */
+typedef struct koml_shared_control {
+	char magic[8];
+	unsigned long long int layout;
+	unsigned long long int generation;
+	unsigned long long int reserved;
+} koml_shared_control_t;
+
+struct koml_shared {
+	char * name;
+	koml_shared_control_t * control;
+	unsigned char writable;
+};
+
+#define KOML_SHARED_MAGIC "KOMLSHM1"
+
+static void koml_internal_shared_segment(char * out, unsigned long long int capacity, char * name, unsigned long long int generation) {
+	snprintf(out, capacity, "%s.%llx", name, generation);
+}
+
+/* where a generation's block is stored for; consecutive generations get different slots so a worker can map the next one before dropping the last */
+static uintptr_t koml_internal_shared_address(char * name, unsigned long long int generation, unsigned long long int block_offset) {
+	if (sizeof(uintptr_t) < 8) {
+		return 0;
+	}
+
+	unsigned long long int slot = (koml_hash(name, strlen(name), 0) + generation) % KOML_SHARED_SLOTS;
+	return (uintptr_t) (KOML_SHARED_BASE + slot * KOML_SHARED_SLOT_SIZE + block_offset);
+}
+
+int koml_shared_open(koml_shared_t ** out_shared, char * name) {
+	*out_shared = NULL;
+
+	/* workers that may only read the channel get a read-only mapping; publishing needs write access */
+	unsigned char writable = 1;
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0 && errno == EACCES) {
+		writable = 0;
+		fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+	}
+	if (fd < 0) {
+		return 20;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (writable && (unsigned long long int) info.st_size < sizeof(koml_shared_control_t) && ftruncate(fd, sizeof(koml_shared_control_t)) != 0)
+		|| (!writable && (unsigned long long int) info.st_size < sizeof(koml_shared_control_t))) {
+		close(fd);
+		return 20;
+	}
+
+	koml_shared_control_t * control = mmap(NULL, sizeof(koml_shared_control_t), (writable) ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (control == MAP_FAILED) {
+		return 20;
+	}
+
+	/* a fresh segment is all zeroes; racing openers write the same bytes */
+	if (writable && control->layout == 0) {
+		memcpy(control->magic, KOML_SHARED_MAGIC, 8);
+		control->layout = KOML_IMAGE_LAYOUT;
+	}
+
+	koml_shared_t * shared = malloc(sizeof(koml_shared_t));
+	char * copy = malloc(strlen(name) + 1);
+	if (shared == NULL || copy == NULL || (control->layout != 0 && (memcmp(control->magic, KOML_SHARED_MAGIC, 8) != 0 || control->layout != KOML_IMAGE_LAYOUT))) {
+		free(shared);
+		free(copy);
+		munmap(control, sizeof(koml_shared_control_t));
+		return (shared == NULL || copy == NULL) ? 1 : 2;
+	}
+
+	strcpy(copy, name);
+	shared->name = copy;
+	shared->control = control;
+	shared->writable = writable;
+	*out_shared = shared;
+	return 0;
+}
+
+unsigned long long int koml_shared_generation(koml_shared_t * shared) {
+	return __atomic_load_n(&shared->control->generation, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * each generation is its own segment, written in full before the channel points at it. the segment it replaces is
+ * unlinked right away: workers still attached keep their mapping, and new attaches only ever see the newest
+ */
+int koml_shared_publish(koml_shared_t * shared, koml_table_t * table, unsigned long long int * out_generation) {
+	if (!shared->writable || table->base != NULL) {
+		return 1;
+	}
+
+	int ret = koml_table_freeze(table);
+	if (ret != 0) {
+		return ret;
+	}
+
+	/* an image past its slot would overlap the next generation's, and every worker would silently map a private copy */
+	unsigned long long int block_offset = koml_internal_align(sizeof(koml_image_header_t), 64);
+	unsigned long long int block_size = table->block_size - ((char *) table->symbols - table->block);
+	if (block_size > KOML_SHARED_SLOT_SIZE - block_offset) {
+		return 1;
+	}
+
+	unsigned long long int generation = __atomic_add_fetch(&shared->control->reserved, 1, __ATOMIC_RELAXED);
+	unsigned long long int size = 0;
+	char * image = koml_internal_image_build(table, koml_internal_shared_address(shared->name, generation, block_offset), 0, 0, &size);
+	if (image == NULL) {
+		return 1;
+	}
+
+	unsigned long long int segment_capacity = strlen(shared->name) + 24;
+	char * segment = malloc(segment_capacity);
+	if (segment == NULL) {
+		free(image);
+		return 1;
+	}
+	koml_internal_shared_segment(segment, segment_capacity, shared->name, generation);
+
+	int fd = shm_open(segment, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	ret = (fd < 0) ? 20 : koml_internal_write_all(fd, image, size);
+	free(image);
+	if (fd >= 0 && close(fd) != 0) {
+		ret = 20;
+	}
+	if (ret != 0) {
+		if (fd >= 0) {
+			shm_unlink(segment);
+		}
+		free(segment);
+		return ret;
+	}
 
-					out_table->symbols[out_table->length - 1].data.string[ptr->stride] = '\0';
-					memcpy(out_table->symbols[out_table->length - 1].data.string, ptr->data.string, ptr->stride);
-
-					word.start = NULL;
-					word.length = 0;
-					word.hash = 0;
-					state = KOML_PARSER_STATE_NONE;
-					continue;
-				} else {
-					printf("Invalid string literal (line %llu: column %llu)\n  | ", line + 1, column + 1);
-					koml_printline(buffer, line, column);
-					printf("\n  | ");
-					koml_printcursor(column);
-					printf("\n");
-					return 10;
-				}
+	/* a publisher that reserved a later generation may already have published it; then this one is stale and goes */
+	unsigned long long int previous = __atomic_load_n(&shared->control->generation, __ATOMIC_RELAXED);
+	while (previous < generation && !__atomic_compare_exchange_n(&shared->control->generation, &previous, generation, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	if (previous < generation && previous != 0) {
+		koml_internal_shared_segment(segment, segment_capacity, shared->name, previous);
+	}
+	if (previous != 0) {
+		shm_unlink(segment);
+	}
 
-				if (word.start != NULL) {
-					++word.length;
-				}
-				continue;
-			case KOML_PARSER_STATE_BOOLEAN_WAIT:
-				if (is_whitespace(c)) {
-					continue;
-				}
+	free(segment);
+	if (out_generation != NULL) {
+		*out_generation = generation;
+	}
+	return 0;
+}
 
-				word.start = &buffer[i];
-				word.length = 0;
-				state = KOML_PARSER_STATE_BOOLEAN_NAME;
-				continue;
-			case KOML_PARSER_STATE_BOOLEAN_NAME:
-				if (is_whitespace(c)) {
-					continue;
-				}
+int koml_shared_attach(koml_shared_t * shared, koml_table_t * out_table, unsigned long long int * out_generation) {
+	unsigned long long int segment_capacity = strlen(shared->name) + 24;
+	char * segment = malloc(segment_capacity);
+	if (segment == NULL) {
+		return 1;
+	}
 
-				++word.length;
-				if (c == '=') {
-					out_table->symbols[out_table->length - 1].name = NULL;
-					unsigned long long int tmp_length = 0;
-					if (section.start != NULL) {
-						tmp_length = word.length + section.length + 1;
-						out_table->symbols[out_table->length - 1].name = malloc(tmp_length + 1);
-						if (out_table->symbols[out_table->length - 1].name == NULL || word.start == NULL || section.start == NULL) {
-							printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 1;
-						}
-
-						out_table->symbols[out_table->length - 1].name[tmp_length] = '\0';
-
-						memcpy(out_table->symbols[out_table->length - 1].name, section.start, section.length);
-						out_table->symbols[out_table->length - 1].name[section.length] = ':';
-						memcpy(&out_table->symbols[out_table->length - 1].name[section.length + 1], word.start, word.length);
-					} else {
-						tmp_length = word.length;
-						out_table->symbols[out_table->length - 1].name = malloc(tmp_length + 1);
-						if (out_table->symbols[out_table->length - 1].name == NULL || word.start == NULL) {
-							printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 1;
-						}
-						out_table->symbols[out_table->length - 1].name[tmp_length] = '\0';
-						memcpy(out_table->symbols[out_table->length - 1].name, word.start, tmp_length);
-					}
-					if (out_table->symbols[out_table->length - 1].name == NULL) {
-						printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 1;
-					}
+	koml_internal_table_init(out_table);
+
+	/* the newest segment can be unlinked between reading the generation and opening it; a newer generation is then already published */
+	int ret = 20;
+	unsigned long long int generation = koml_shared_generation(shared);
+	while (generation != 0) {
+		koml_internal_shared_segment(segment, segment_capacity, shared->name, generation);
+		int fd = shm_open(segment, O_RDONLY | O_CLOEXEC, 0);
+		if (fd >= 0) {
+			ret = (koml_internal_image_map(out_table, fd, NULL) == 0) ? 0 : 2;
+			close(fd);
+			break;
+		}
 
-					out_table->hashes[out_table->length - 1] = koml_internal_hash(out_table->symbols[out_table->length - 1].name, tmp_length);
-
-					word.start = NULL;
-					word.length = 0;
-					word.hash = 0;
-					state = KOML_PARSER_STATE_BOOLEAN_VALUE;
-				} else if ((isalnum(c) || ispunct(c)) && word.start != NULL && is_whitespace(prevc)) {
-					printf("Invalid section name (line %llu: column %llu)\n  | ", line + 1, column);
-					koml_printline(buffer, line, column);
-					printf("\n  | ");
-					koml_printcursor(column - 1);
-					printf("\n");
-					return 14;
-				}
+		unsigned long long int newest = koml_shared_generation(shared);
+		if (errno != ENOENT || newest == generation) {
+			break;
+		}
+		generation = newest;
+	}
 
-				continue;
-			case KOML_PARSER_STATE_BOOLEAN_VALUE:
-				if (is_whitespace(c)) {
-					continue;
-				}
+	free(segment);
+	if (ret == 0 && out_generation != NULL) {
+		*out_generation = generation;
+	}
+	return ret;
+}
 
-				if (c == '@') {
-					koml_symbol_t * ptr;
-					++i;
-					c = buffer[i];
-					word.start = &buffer[i];
-					word.length = 0;
-					while (c != ';') {
-						++i;
-						++word.length;
-						if (i >= buffer_length) {
-							printf("Variable reference never ended (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 16;
-						}
-						c = buffer[i];
-					}
-					ptr = koml_table_symbol_word(out_table, word.start, word.length);
-					if (ptr == NULL) {
-						printf("Variable reference to undefined symbol (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 17;
-					}
+int koml_shared_close(koml_shared_t * shared, unsigned char unpublish) {
+	if (unpublish && shared->writable) {
+		unsigned long long int generation = koml_shared_generation(shared);
+		if (generation != 0) {
+			unsigned long long int segment_capacity = strlen(shared->name) + 24;
+			char * segment = malloc(segment_capacity);
+			if (segment != NULL) {
+				koml_internal_shared_segment(segment, segment_capacity, shared->name, generation);
+				shm_unlink(segment);
+				free(segment);
+			}
+		}
+		shm_unlink(shared->name);
+	}
 
-					if (ptr->type != KOML_TYPE_BOOLEAN) {
-						printf("Invalid type of variable reference (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 18;
-					}
+	munmap(shared->control, sizeof(koml_shared_control_t));
+	free(shared->name);
+	free(shared);
+	return 0;
+}
 
-					out_table->symbols[out_table->length - 1].data.boolean = ptr->data.boolean;
+typedef struct koml_deque {
+	pthread_mutex_t lock;
+	unsigned long long int * tasks;
+	unsigned long long int head;
+	unsigned long long int tail;
+} koml_deque_t;
+
+/* one file on its way from disk to the parser */
+typedef struct koml_read {
+	unsigned long long int task;
+	int fd;
+	char * buffer;
+	unsigned long long int size;
+	unsigned long long int done;
+} koml_read_t;
+
+typedef struct koml_pool {
+	koml_deque_t * deques;
+	unsigned int threads;
+	char ** paths;
+	koml_table_t * tables;
+	int * errors;
+	char ** buffers;
+	unsigned long long int * lengths;
+	/* task indices by descending file size; readers claim them through next */
+	unsigned long long int * order;
+	unsigned long long int count;
+	unsigned long long int next;
+	/* buffers handed to the parse workers so far; guarded by lock */
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	unsigned long long int delivered;
+} koml_pool_t;
+
+typedef struct koml_worker {
+	koml_pool_t * pool;
+	unsigned int id;
+} koml_worker_t;
+
+/* the owner takes from the head (oldest completion), thieves take from the tail */
+static unsigned char koml_deque_take(koml_deque_t * deque, unsigned char steal, unsigned long long int * out_task) {
+	unsigned char found = 0;
+
+	pthread_mutex_lock(&deque->lock);
+	if (deque->head < deque->tail) {
+		*out_task = (steal) ? deque->tasks[--deque->tail] : deque->tasks[deque->head++];
+		found = 1;
+	}
+	pthread_mutex_unlock(&deque->lock);
 
-					word.start = NULL;
-					word.length = 0;
-					word.hash = 0;
-					state = KOML_PARSER_STATE_NONE;
-					continue;
-				}
+	return found;
+}
 
-				if (c == ';') {
-					if (!is_boolean(word.start, word.length)) {
-						printf("Invalid boolean value (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 5;
-					}
-					unsigned char value = wtotf(word.start, word.length);
-					out_table->symbols[out_table->length - 1].data.boolean = value;
-
-					word.start = NULL;
-					word.length = 0;
-					word.hash = 0;
-					state = KOML_PARSER_STATE_NONE;
-					continue;
-				}
+static int koml_internal_read_open(koml_pool_t * pool, koml_read_t * read) {
+	read->fd = open(pool->paths[read->task], O_RDONLY | O_CLOEXEC);
+	read->buffer = NULL;
+	read->size = 0;
+	read->done = 0;
+	if (read->fd < 0) {
+		return 20;
+	}
 
-				if (word.start == NULL) {
-					word.start = &buffer[i];
-					word.length = 0;
-				}
-				++word.length;
-				continue;
-			case KOML_PARSER_STATE_ARRAY_TYPE_WAIT:
-				if (is_whitespace(c)) {
-					continue;
-				}
-				if (c == 'i') {
-					out_table->symbols[out_table->length - 1].data.array.length = 0;
-					out_table->symbols[out_table->length - 1].data.array.type = KOML_TYPE_INT;
-					state = KOML_PARSER_STATE_ARRAY_WAIT;
-				}
-				if (c == 'f') {
-					out_table->symbols[out_table->length - 1].data.array.length = 0;
-					out_table->symbols[out_table->length - 1].data.array.type = KOML_TYPE_FLOAT;
-					state = KOML_PARSER_STATE_ARRAY_WAIT;
-				}
-				if (c == 's') {
-					out_table->symbols[out_table->length - 1].data.array.length = 0;
-					out_table->symbols[out_table->length - 1].data.array.type = KOML_TYPE_STRING;
-					state = KOML_PARSER_STATE_ARRAY_WAIT;
-				}
-				if (c == 'b') {
-					out_table->symbols[out_table->length - 1].data.array.length = 0;
-					out_table->symbols[out_table->length - 1].data.array.type = KOML_TYPE_BOOLEAN;
-					state = KOML_PARSER_STATE_ARRAY_WAIT;
-				}
+	struct stat st;
+	if (fstat(read->fd, &st) != 0) {
+		return 20;
+	}
 
-				if (state == KOML_PARSER_STATE_ARRAY_TYPE_WAIT && !is_whitespace(c)) {
-					printf("Invalid array type (line %llu: column %llu)\n  | ", line + 1, column + 1);
-					koml_printline(buffer, line, column);
-					printf("\n  | ");
-					koml_printcursor(column);
-					printf("\n");
-					return 12;
-				}
-				continue;
-			case KOML_PARSER_STATE_ARRAY_WAIT:
-				if (is_whitespace(c)) {
-					continue;
-				}
+	read->size = st.st_size;
+	read->buffer = malloc(read->size + 1);
+	if (read->buffer == NULL) {
+		return 1;
+	}
+
+	return 0;
+}
+
+/* blocking reads for whatever is left of the file; a file that shrank is cut short */
+static int koml_internal_read_rest(koml_read_t * read) {
+	while (read->done < read->size) {
+		ssize_t got = pread(read->fd, read->buffer + read->done, read->size - read->done, read->done);
+		if (got < 0) {
+			return 20;
+		}
+		if (got == 0) {
+			read->size = read->done;
+		}
+		read->done += got;
+	}
+
+	return 0;
+}
+
+/* publishes a finished read (or its error) to the parse workers, spreading completions round-robin over the deques */
+static void koml_internal_read_deliver(koml_pool_t * pool, koml_read_t * read, int error) {
+	if (read->fd >= 0) {
+		close(read->fd);
+	}
+
+	if (error != 0) {
+		free(read->buffer);
+		read->buffer = NULL;
+	} else {
+		read->buffer[read->size] = '\0';
+	}
+	pool->buffers[read->task] = read->buffer;
+	pool->lengths[read->task] = read->size;
+	pool->errors[read->task] = error;
+
+	pthread_mutex_lock(&pool->lock);
+	koml_deque_t * deque = &pool->deques[pool->delivered % pool->threads];
+	pthread_mutex_lock(&deque->lock);
+	deque->tasks[deque->tail++] = read->task;
+	pthread_mutex_unlock(&deque->lock);
+
+	if (++pool->delivered == pool->count) {
+		pthread_cond_broadcast(&pool->ready);
+	} else {
+		pthread_cond_signal(&pool->ready);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void * koml_internal_reader(void * arg) {
+	koml_pool_t * pool = arg;
+	koml_read_t read;
+
+	for (;;) {
+		unsigned long long int claimed = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+		if (claimed >= pool->count) {
+			return NULL;
+		}
+
+		read.task = pool->order[claimed];
+		int ret = koml_internal_read_open(pool, &read);
+		if (ret == 0) {
+			ret = koml_internal_read_rest(&read);
+		}
+		koml_internal_read_deliver(pool, &read, ret);
+	}
+}
+
+#ifdef KOML_HAVE_IO_URING
+typedef struct koml_uring {
+	int fd;
+	unsigned int * sq_tail;
+	unsigned int * sq_mask;
+	unsigned int * sq_array;
+	unsigned int * cq_head;
+	unsigned int * cq_tail;
+	unsigned int * cq_mask;
+	struct io_uring_sqe * sqes;
+	struct io_uring_cqe * cqes;
+	void * sq_ring;
+	unsigned long long int sq_ring_size;
+	void * cq_ring;
+	unsigned long long int cq_ring_size;
+	unsigned long long int sqes_size;
+	unsigned int entries;
+} koml_uring_t;
+
+static void koml_internal_uring_destroy(koml_uring_t * ring) {
+	if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+		munmap(ring->sqes, ring->sqes_size);
+	}
+	if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	}
+	if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED) {
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	}
+	close(ring->fd);
+}
+
+/* raw syscalls so that liburing is not needed; returns non-zero when the kernel refuses (old kernel, seccomp) */
+static int koml_internal_uring_init(koml_uring_t * ring, unsigned int entries) {
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	memset(ring, 0, sizeof(koml_uring_t));
+
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0) {
+		return 1;
+	}
+
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_size > ring->sq_ring_size) {
+			ring->sq_ring_size = ring->cq_ring_size;
+		}
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED) {
+		koml_internal_uring_destroy(ring);
+		return 1;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED) {
+			koml_internal_uring_destroy(ring);
+			return 1;
+		}
+	}
+
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		koml_internal_uring_destroy(ring);
+		return 1;
+	}
+
+	char * sq = ring->sq_ring;
+	char * cq = ring->cq_ring;
+	ring->sq_tail = (unsigned int *) (sq + params.sq_off.tail);
+	ring->sq_mask = (unsigned int *) (sq + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *) (sq + params.sq_off.array);
+	ring->cq_head = (unsigned int *) (cq + params.cq_off.head);
+	ring->cq_tail = (unsigned int *) (cq + params.cq_off.tail);
+	ring->cq_mask = (unsigned int *) (cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+	ring->entries = params.sq_entries;
+
+	return 0;
+}
+
+static void koml_internal_uring_queue(koml_uring_t * ring, koml_read_t * read, unsigned long long int slot) {
+	unsigned int tail = *ring->sq_tail;
+	unsigned int index = tail & *ring->sq_mask;
+	unsigned long long int chunk = read->size - read->done;
+
+	struct io_uring_sqe * sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = read->fd;
+	sqe->addr = (unsigned long long int) (read->buffer + read->done);
+	sqe->len = (chunk > (1U << 30)) ? (1U << 30) : chunk;
+	sqe->off = read->done;
+	sqe->user_data = slot;
+
+	ring->sq_array[index] = index;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * keeps up to ring->entries reads in flight and delivers each file as soon as its last chunk lands.
+ * reads the kernel rejects (e.g. no IORING_OP_READ before 5.6) finish with pread instead
+ */
+static void koml_internal_uring_drive(koml_pool_t * pool, koml_uring_t * ring) {
+	koml_read_t * reads = malloc(ring->entries * sizeof(koml_read_t));
+	unsigned int * free_slots = malloc(ring->entries * sizeof(unsigned int));
+	if (reads == NULL || free_slots == NULL) {
+		free(reads);
+		free(free_slots);
+		koml_internal_reader(pool);
+		return;
+	}
+
+	unsigned int free_count = ring->entries;
+	for (unsigned int i = 0; i < ring->entries; ++i) {
+		free_slots[i] = ring->entries - 1 - i;
+	}
+
+	unsigned int queued = 0;
+	unsigned int in_flight = 0;
+	unsigned char broken = 0;
 
-				word.start = &buffer[i];
-				word.length = 0;
-				state = KOML_PARSER_STATE_ARRAY_NAME;
+	while (!broken) {
+		while (free_count > 0 && pool->next < pool->count) {
+			unsigned int slot = free_slots[free_count - 1];
+			koml_read_t * read = &reads[slot];
+			read->task = pool->order[pool->next++];
+
+			int ret = koml_internal_read_open(pool, read);
+			if (ret != 0 || read->size == 0) {
+				koml_internal_read_deliver(pool, read, ret);
 				continue;
-			case KOML_PARSER_STATE_ARRAY_NAME:
-				if (is_whitespace(c)) {
-					continue;
-				}
+			}
 
-				++word.length;
-				if (c == '=') {
-					out_table->symbols[out_table->length - 1].name = NULL;
-					unsigned long long int tmp_length = 0;
-					if (section.start != NULL) {
-						tmp_length = word.length + section.length + 1;
-						out_table->symbols[out_table->length - 1].name = malloc(tmp_length + 1);
-						if (out_table->symbols[out_table->length - 1].name == NULL || word.start == NULL || section.start == NULL) {
-							printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 1;
-						}
-
-						out_table->symbols[out_table->length - 1].name[tmp_length] = '\0';
-
-						memcpy(out_table->symbols[out_table->length - 1].name, section.start, section.length);
-						out_table->symbols[out_table->length - 1].name[section.length] = ':';
-						memcpy(&out_table->symbols[out_table->length - 1].name[section.length + 1], word.start, word.length);
-					} else {
-						tmp_length = word.length;
-						out_table->symbols[out_table->length - 1].name = malloc(tmp_length + 1);
-						if (out_table->symbols[out_table->length - 1].name == NULL || word.start == NULL) {
-							printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 1;
-						}
-						out_table->symbols[out_table->length - 1].name[tmp_length] = '\0';
-						memcpy(out_table->symbols[out_table->length - 1].name, word.start, tmp_length);
-					}
-					if (out_table->symbols[out_table->length - 1].name == NULL) {
-						printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 1;
-					}
+			--free_count;
+			koml_internal_uring_queue(ring, read, slot);
+			++queued;
+			++in_flight;
+		}
 
-					out_table->hashes[out_table->length - 1] = koml_internal_hash(out_table->symbols[out_table->length - 1].name, tmp_length);
-
-					word.start = NULL;
-					word.length = 0;
-					word.hash = 0;
-					state = KOML_PARSER_STATE_ARRAY_VALUE;
-				} else if ((isalnum(c) || ispunct(c)) && word.start != NULL && is_whitespace(prevc)) {
-					printf("Invalid array name (line %llu: column %llu)\n  | ", line + 1, column);
-					koml_printline(buffer, line, column);
-					printf("\n  | ");
-					koml_printcursor(column - 1);
-					printf("\n");
-					return 15;
-				}
+		if (in_flight == 0) {
+			break;
+		}
 
+		int entered = syscall(__NR_io_uring_enter, ring->fd, queued, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (entered < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
 				continue;
-			case KOML_PARSER_STATE_ARRAY_VALUE:
-				if (is_whitespace(c)) {
-					continue;
-				}
+			}
+			broken = 1;
+			break;
+		}
+		queued -= entered;
+
+		unsigned int head = *ring->cq_head;
+		unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; ++head) {
+			struct io_uring_cqe * cqe = &ring->cqes[head & *ring->cq_mask];
+			unsigned int slot = cqe->user_data;
+			koml_read_t * read = &reads[slot];
+			int ret = 0;
+
+			if (cqe->res < 0) {
+				ret = koml_internal_read_rest(read);
+			} else if (cqe->res == 0) {
+				read->size = read->done;
+			} else {
+				read->done += cqe->res;
+			}
 
-				if (c == '@') {
-					koml_symbol_t * ptr;
-					++i;
-					c = buffer[i];
-					word.start = &buffer[i];
-					word.length = 0;
-					while (c != ';') {
-						++i;
-						++word.length;
-						if (i >= buffer_length) {
-							printf("Array reference never ended (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 16;
-						}
-						c = buffer[i];
-					}
-					ptr = koml_table_symbol_word(out_table, word.start, word.length);
-					if (ptr == NULL) {
-						printf("Array reference to undefined symbol (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 17;
-					}
+			if (ret == 0 && read->done < read->size) {
+				koml_internal_uring_queue(ring, read, slot);
+				++queued;
+				continue;
+			}
 
-					if (ptr->type != KOML_TYPE_ARRAY) {
-						printf("Invalid type of array reference (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 18;
-					}
+			koml_internal_read_deliver(pool, read, ret);
+			free_slots[free_count++] = slot;
+			--in_flight;
+		}
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	}
 
-					switch (out_table->symbols[out_table->length - 1].data.array.type) {
-						case KOML_TYPE_INT:
-							if (ptr->data.array.type != KOML_TYPE_INT && ptr->data.array.type != KOML_TYPE_FLOAT) {
-								printf("Invalid type of array reference (line %llu: column %llu)\n  | ", line + 1, column + 1);
-								koml_printline(buffer, line, column);
-								printf("\n  | ");
-								koml_printcursor(column);
-								printf("\n");
-								return 18;
-							}
-
-							if (ptr->data.array.type == KOML_TYPE_INT) {
-								koml_array_alloc_new_amount(&out_table->symbols[out_table->length - 1].data.array, ptr->data.array.length);
-								memcpy(out_table->symbols[out_table->length - 1].data.array.elements.i32, ptr->data.array.elements.i32, ptr->data.array.length * 4);
-								memcpy(out_table->symbols[out_table->length - 1].data.array.strides, ptr->data.array.strides, ptr->data.array.length * 4);
-							} else {
-								koml_array_alloc_new_amount(&out_table->symbols[out_table->length - 1].data.array, ptr->data.array.length);
-								for (unsigned long long int i = 0; i < ptr->data.array.length; ++i) {
-									out_table->symbols[out_table->length - 1].data.array.elements.i32[i] = (int) ptr->data.array.elements.f32[i];
-								}
-							}
-							break;
-						case KOML_TYPE_FLOAT:
-							if (ptr->data.array.type != KOML_TYPE_INT && ptr->data.array.type != KOML_TYPE_FLOAT) {
-								printf("Invalid type of array reference (line %llu: column %llu)\n  | ", line + 1, column + 1);
-								koml_printline(buffer, line, column);
-								printf("\n  | ");
-								koml_printcursor(column);
-								printf("\n");
-								return 18;
-							}
-
-							if (ptr->data.array.type == KOML_TYPE_FLOAT) {
-								koml_array_alloc_new_amount(&out_table->symbols[out_table->length - 1].data.array, ptr->data.array.length);
-								memcpy(out_table->symbols[out_table->length - 1].data.array.elements.f32, ptr->data.array.elements.f32, ptr->data.array.length * 4);
-								memcpy(out_table->symbols[out_table->length - 1].data.array.strides, ptr->data.array.strides, ptr->data.array.length * 4);
-							} else {
-								koml_array_alloc_new_amount(&out_table->symbols[out_table->length - 1].data.array, ptr->data.array.length);
-								for (unsigned long long int i = 0; i < ptr->data.array.length; ++i) {
-									out_table->symbols[out_table->length - 1].data.array.elements.f32[i] = (float) ptr->data.array.elements.i32[i];
-								}
-							}
-							break;
-						case KOML_TYPE_STRING:
-							if (ptr->data.array.type != KOML_TYPE_STRING) {
-								printf("Invalid type of array reference (line %llu: column %llu)\n  | ", line + 1, column + 1);
-								koml_printline(buffer, line, column);
-								printf("\n  | ");
-								koml_printcursor(column);
-								printf("\n");
-								return 18;
-							}
-
-							koml_array_alloc_new_amount(&out_table->symbols[out_table->length - 1].data.array, ptr->data.array.length);
-							memcpy(out_table->symbols[out_table->length - 1].data.array.strides, ptr->data.array.strides, ptr->data.array.length * 4);
-							for (unsigned long long int i = 0; i < ptr->data.array.length; ++i) {
-								out_table->symbols[out_table->length - 1].data.array.elements.string[i] = malloc(ptr->data.array.strides[i] + 1);
-								if (out_table->symbols[out_table->length - 1].data.array.elements.string[i] == NULL) {
-									printf("Internal error (line %llu: column %llu)\n  | ", line + 1, column + 1);
-									koml_printline(buffer, line, column);
-									printf("\n  | ");
-									koml_printcursor(column);
-									printf("\n");
-									return 1;
-								}
-
-								memcpy(out_table->symbols[out_table->length - 1].data.array.elements.string[i], ptr->data.array.elements.string[i], ptr->data.array.strides[i]);
-								out_table->symbols[out_table->length - 1].data.array.elements.string[i][ptr->data.array.strides[i]] = '\0';
-							}
-							
-							break;
-						case KOML_TYPE_BOOLEAN:
-							if (ptr->data.array.type != KOML_TYPE_BOOLEAN) {
-								printf("Invalid type of array reference (line %llu: column %llu)\n  | ", line + 1, column + 1);
-								koml_printline(buffer, line, column);
-								printf("\n  | ");
-								koml_printcursor(column);
-								printf("\n");
-								return 18;
-							}
-
-							koml_array_alloc_new_amount(&out_table->symbols[out_table->length - 1].data.array, ptr->data.array.length);
-							memcpy(out_table->symbols[out_table->length - 1].data.array.elements.boolean, ptr->data.array.elements.boolean, ptr->data.array.length);
-							memcpy(out_table->symbols[out_table->length - 1].data.array.strides, ptr->data.array.strides, ptr->data.array.length * 4);
-							
-							break;
-						default:
-							printf("Invalid array reference type (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 19;
-					}
+	/*
+	 * the ring stopped accepting work. reads the kernel already took still land in their buffers, so they are waited for
+	 * (polling the completion queue if even waiting fails) before anything is finished synchronously and freed
+	 */
+	if (broken) {
+		unsigned int accepted = in_flight - queued;
+		while (accepted > 0) {
+			if (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+				struct timespec pause = { .tv_sec = 0, .tv_nsec = 1000000 };
+				nanosleep(&pause, NULL);
+			}
 
-					word.start = NULL;
-					word.length = 0;
-					word.hash = 0;
-					state = KOML_PARSER_STATE_NONE;
-					continue;
+			unsigned int head = *ring->cq_head;
+			unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+			for (; head != tail && accepted > 0; ++head, --accepted) {
+				struct io_uring_cqe * cqe = &ring->cqes[head & *ring->cq_mask];
+				koml_read_t * read = &reads[cqe->user_data];
+				if (cqe->res == 0) {
+					read->size = read->done;
+				} else if (cqe->res > 0) {
+					read->done += cqe->res;
 				}
+			}
+			__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+		}
 
-				if (isalnum(c) && word.start == NULL) {
-					word.start = &buffer[i];
-					word.length = 0;
-					word.hash = 0;
+		for (unsigned int slot = 0; slot < ring->entries; ++slot) {
+			unsigned char idle = 0;
+			for (unsigned int i = 0; i < free_count; ++i) {
+				if (free_slots[i] == slot) {
+					idle = 1;
+					break;
 				}
+			}
+			if (!idle) {
+				koml_internal_read_deliver(pool, &reads[slot], koml_internal_read_rest(&reads[slot]));
+			}
+		}
+		koml_internal_reader(pool);
+	}
 
-				if (out_table->symbols[out_table->length - 1].data.array.type != KOML_TYPE_STRING) {
-					if (c == ',' || c == ';') {
-						koml_array_alloc_new(&out_table->symbols[out_table->length - 1].data.array);
-					} else {
-						++word.length;
-					}
-				} else {
-					if (c == '"') {
-						koml_array_alloc_new(&out_table->symbols[out_table->length - 1].data.array);
-					} else {
-						++word.length;
-					}
-				}
+	free(reads);
+	free(free_slots);
+}
+#endif
 
-				switch (out_table->symbols[out_table->length - 1].data.array.type) {
-					case KOML_TYPE_INT:
-						if (c == ',') {
-							int value = wtoi(word.start, word.length, 10);
-							out_table->symbols[out_table->length - 1].data.array.elements.i32[out_table->symbols[out_table->length - 1].data.array.length - 1] = value;
-
-							word.start = NULL;
-							word.length = 0;
-							word.hash = 0;
-						} else if (c == ';') {
-							int value = wtoi(word.start, word.length, 10);
-							out_table->symbols[out_table->length - 1].data.array.elements.i32[out_table->symbols[out_table->length - 1].data.array.length - 1] = value;
-
-							word.start = NULL;
-							word.length = 0;
-							word.hash = 0;
-
-							state = KOML_PARSER_STATE_NONE;
-						} else if (!is_num(c)) {
-							printf("Invalid integer value (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 11;
-						}
-						continue;
-					case KOML_TYPE_FLOAT:
-						if (c == ',') {
-							float value = wtof(word.start, word.length);
-							out_table->symbols[out_table->length - 1].data.array.elements.f32[out_table->symbols[out_table->length - 1].data.array.length - 1] = value;
-
-							word.start = NULL;
-							word.length = 0;
-							word.hash = 0;
-						} else if (c == ';') {
-							float value = wtof(word.start, word.length);
-							out_table->symbols[out_table->length - 1].data.array.elements.f32[out_table->symbols[out_table->length - 1].data.array.length - 1] = value;
-
-							word.start = NULL;
-							word.length = 0;
-							word.hash = 0;
-
-							state = KOML_PARSER_STATE_NONE;
-						} else if (!is_num(c) && c != '.') {
-							printf("Invalid float value (line %llu: column %llu)\n  | ", line + 1, column + 1);
-							koml_printline(buffer, line, column);
-							printf("\n  | ");
-							koml_printcursor(column);
-							printf("\n");
-							return 10;
-						}
-
-						continue;
-					case KOML_TYPE_STRING:
-						if (is_whitespace(c)) {
-							continue;
-						}
-
-						if (c == '"') {
-							++i;
-							c = buffer[i];
-							word.start = &buffer[i];
-							word.length = 0;
-							while (c != '"') {
-								++i;
-								++word.length;
-								if (i >= buffer_length) {
-									printf("String literal never ended (line %llu: column %llu)\n  | ", line + 1, column + 1);
-									koml_printline(buffer, line, column);
-									printf("\n  | ");
-									koml_printcursor(column);
-									printf("\n");
-									return 2;
-								}
-								c = buffer[i];
-							}
-
-							out_table->symbols[out_table->length - 1].data.array.strides[out_table->symbols[out_table->length - 1].data.array.length - 1] = word.length;
-							out_table->symbols[out_table->length - 1].data.array.elements.string[out_table->symbols[out_table->length - 1].data.array.length - 1] = malloc(word.length + 1);
-							if (out_table->symbols[out_table->length - 1].data.array.elements.string[out_table->symbols[out_table->length - 1].data.array.length - 1] == NULL) {
-								printf("Failed to allocate string buffer (line %llu: column %llu)\n  | ", line + 1, column + 1);
-								koml_printline(buffer, line, column);
-								printf("\n  | ");
-								koml_printcursor(column);
-								printf("\n");
-								return 3;
-							}
-
-							out_table->symbols[out_table->length - 1].data.array.elements.string[out_table->symbols[out_table->length - 1].data.array.length - 1][word.length] = '\0';
-							memcpy(out_table->symbols[out_table->length - 1].data.array.elements.string[out_table->symbols[out_table->length - 1].data.array.length - 1], word.start, word.length);
-						}
-
-						if (c == ',') {
-							word.start = NULL;
-							word.length = 0;
-							word.hash = 0;
-							continue;
-						}
-
-						if (c == ';') {
-							word.start = NULL;
-							word.length = 0;
-							word.hash = 0;
-							state = KOML_PARSER_STATE_NONE;
-							continue;
-						}
-
-						if (word.start != NULL) {
-							++word.length;
-						}
-						continue;
-					case KOML_TYPE_BOOLEAN:
-						if (c == ',') {
-							if (!is_boolean(word.start, word.length)) {
-								printf("Invalid boolean value (line %llu: column %llu)\n  | ", line + 1, column + 1);
-								koml_printline(buffer, line, column);
-								printf("\n  | ");
-								koml_printcursor(column);
-								printf("\n");
-								return 5;
-							}
-
-							unsigned char value = wtotf(word.start, word.length);
-							out_table->symbols[out_table->length - 1].data.array.elements.boolean[out_table->symbols[out_table->length - 1].data.array.length - 1] = value;
-
-							word.start = NULL;
-							word.length = 0;
-							word.hash = 0;
-						}
-						if (c == ';') {
-							if (!is_boolean(word.start, word.length)) {
-								printf("Invalid boolean value (line %llu: column %llu)\n  | ", line + 1, column + 1);
-								koml_printline(buffer, line, column);
-								printf("\n  | ");
-								koml_printcursor(column);
-								printf("\n");
-								return 5;
-							}
-
-							unsigned char value = wtotf(word.start, word.length);
-							out_table->symbols[out_table->length - 1].data.array.elements.boolean[out_table->symbols[out_table->length - 1].data.array.length - 1] = value;
-
-							word.start = NULL;
-							word.length = 0;
-							word.hash = 0;
-
-							state = KOML_PARSER_STATE_NONE;
-						}
-						continue;
-					case KOML_TYPE_ARRAY:
-						printf("Arrays of arrays are not supported (line %llu: column %llu)\n  | ", line + 1, column + 1);
-						koml_printline(buffer, line, column);
-						printf("\n  | ");
-						koml_printcursor(column);
-						printf("\n");
-						return 6;
-					case KOML_TYPE_UNKNOWN:
-					default:
-						printf("Unknown type\n");
-						return 7;
-				}
+static void * koml_internal_worker(void * arg) {
+	koml_worker_t * worker = arg;
+	koml_pool_t * pool = worker->pool;
+	unsigned long long int task = 0;
 
-				continue;
-			case 0:
-			default:
-				break;
-		}
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		unsigned long long int seen = pool->delivered;
+		pthread_mutex_unlock(&pool->lock);
 
-		if (word.start != NULL) {
-			word.start = NULL;
-			word.length = 0;
+		unsigned char found = koml_deque_take(&pool->deques[worker->id], 0, &task);
+		for (unsigned int i = 1; !found && i < pool->threads; ++i) {
+			found = koml_deque_take(&pool->deques[(worker->id + i) % pool->threads], 1, &task);
 		}
 
-		if (c == '[') {
-			state = KOML_PARSER_STATE_SECTION_WAIT;
+		if (found) {
+			if (pool->errors[task] == 0) {
+				pool->errors[task] = koml_table_load_ex(&pool->tables[task], pool->buffers[task], pool->lengths[task], NULL);
+				free(pool->buffers[task]);
+			}
+			continue;
 		}
 
-		if (c == 'i') {
-			koml_table_alloc_new(out_table);
-			out_table->symbols[out_table->length - 1].stride = 4;
-			out_table->symbols[out_table->length - 1].type = KOML_TYPE_INT;
-			state = KOML_PARSER_STATE_INTEGER_WAIT;
+		/* nothing queued: sleep until the next delivery, or leave once every file has been delivered */
+		pthread_mutex_lock(&pool->lock);
+		while (pool->delivered == seen && pool->delivered < pool->count) {
+			pthread_cond_wait(&pool->ready, &pool->lock);
 		}
-		if (c == 'f') {
-			koml_table_alloc_new(out_table);
-			out_table->symbols[out_table->length - 1].stride = 4;
-			out_table->symbols[out_table->length - 1].type = KOML_TYPE_FLOAT;
-			state = KOML_PARSER_STATE_FLOAT_WAIT;
+		unsigned char done = (pool->delivered == seen);
+		pthread_mutex_unlock(&pool->lock);
+
+		if (done) {
+			return NULL;
 		}
-		if (c == 's') {
-			koml_table_alloc_new(out_table);
-			out_table->symbols[out_table->length - 1].stride = 0;
-			out_table->symbols[out_table->length - 1].type = KOML_TYPE_STRING;
-			state = KOML_PARSER_STATE_STRING_WAIT;
+	}
+}
+
+typedef struct koml_sized_path {
+	unsigned long long int size;
+	unsigned long long int index;
+} koml_sized_path_t;
+
+static int koml_internal_size_compare(const void * a, const void * b) {
+	const koml_sized_path_t * pa = a;
+	const koml_sized_path_t * pb = b;
+	return (pa->size > pb->size) ? -1 : (pa->size < pb->size);
+}
+
+int koml_load_many(char ** paths, unsigned long long int count, koml_table_t * out_tables, int * out_errors, unsigned int threads) {
+	if (paths == NULL || out_tables == NULL || out_errors == NULL) {
+		return 1;
+	}
+
+	if (threads == 0) {
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (online > 0) ? (unsigned int) online : 1;
+	}
+	if (threads > count) {
+		threads = (count > 0) ? (unsigned int) count : 1;
+	}
+	unsigned int readers = (count < KOML_READ_DEPTH) ? (unsigned int) count : KOML_READ_DEPTH;
+	if (readers == 0) {
+		readers = 1;
+	}
+
+	koml_sized_path_t * sized = malloc((count + 1) * sizeof(koml_sized_path_t));
+	unsigned long long int * order = malloc((count + 1) * sizeof(unsigned long long int));
+	unsigned long long int * tasks = malloc((count + threads) * sizeof(unsigned long long int));
+	char ** buffers = malloc((count + 1) * sizeof(char *));
+	unsigned long long int * lengths = malloc((count + 1) * sizeof(unsigned long long int));
+	koml_deque_t * deques = calloc(threads, sizeof(koml_deque_t));
+	koml_worker_t * workers = calloc(threads, sizeof(koml_worker_t));
+	pthread_t * handles = calloc(threads + readers, sizeof(pthread_t));
+
+	if (sized == NULL || order == NULL || tasks == NULL || buffers == NULL || lengths == NULL || deques == NULL || workers == NULL || handles == NULL) {
+		free(sized);
+		free(order);
+		free(tasks);
+		free(buffers);
+		free(lengths);
+		free(deques);
+		free(workers);
+		free(handles);
+		return 1;
+	}
+
+	/* largest files are read first so that a single big file does not end up as the straggler */
+	for (unsigned long long int i = 0; i < count; ++i) {
+		struct stat st;
+		sized[i].size = (stat(paths[i], &st) == 0) ? (unsigned long long int) st.st_size : 0;
+		sized[i].index = i;
+		koml_internal_table_init(&out_tables[i]);
+	}
+	qsort(sized, count, sizeof(koml_sized_path_t), koml_internal_size_compare);
+	for (unsigned long long int i = 0; i < count; ++i) {
+		order[i] = sized[i].index;
+	}
+
+	koml_pool_t pool = {
+		.deques = deques,
+		.threads = threads,
+		.paths = paths,
+		.tables = out_tables,
+		.errors = out_errors,
+		.buffers = buffers,
+		.lengths = lengths,
+		.order = order,
+		.count = count,
+	};
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.ready, NULL);
+
+	/* the n-th delivery lands on deque n % threads, so no deque holds more than per_thread tasks */
+	unsigned long long int per_thread = (count + threads - 1) / threads;
+	for (unsigned int t = 0; t < threads; ++t) {
+		pthread_mutex_init(&deques[t].lock, NULL);
+		deques[t].tasks = &tasks[t * per_thread];
+	}
+
+	/* threads that fail to start simply leave their deque to be stolen from */
+	unsigned int started = 0;
+	for (unsigned int t = 0; t < threads; ++t) {
+		workers[t].pool = &pool;
+		workers[t].id = t;
+		if (t > 0 && pthread_create(&handles[started], NULL, koml_internal_worker, &workers[t]) == 0) {
+			++started;
 		}
-		if (c == 'b') {
-			koml_table_alloc_new(out_table);
-			out_table->symbols[out_table->length - 1].stride = 1;
-			out_table->symbols[out_table->length - 1].type = KOML_TYPE_BOOLEAN;
-			state = KOML_PARSER_STATE_BOOLEAN_WAIT;
+	}
+
+	/* the calling thread feeds the parsers: through io_uring when the kernel allows it, otherwise with a pool of pread threads */
+	unsigned char submitted = 0;
+#ifdef KOML_HAVE_IO_URING
+	koml_uring_t ring;
+	if (koml_internal_uring_init(&ring, readers) == 0) {
+		koml_internal_uring_drive(&pool, &ring);
+		koml_internal_uring_destroy(&ring);
+		submitted = 1;
+	}
+#endif
+	if (!submitted) {
+		unsigned int reading = started;
+		for (unsigned int r = 1; r < readers; ++r) {
+			if (pthread_create(&handles[reading], NULL, koml_internal_reader, &pool) == 0) {
+				++reading;
+			}
 		}
-		if (c == 'a') {
-			koml_table_alloc_new(out_table);
-			out_table->symbols[out_table->length - 1].stride = 0;
-			out_table->symbols[out_table->length - 1].type = KOML_TYPE_ARRAY;
-			state = KOML_PARSER_STATE_ARRAY_TYPE_WAIT;
+		koml_internal_reader(&pool);
+		for (unsigned int r = started; r < reading; ++r) {
+			pthread_join(handles[r], NULL);
 		}
+	}
+
+	koml_internal_worker(&workers[0]);
+	for (unsigned int t = 0; t < started; ++t) {
+		pthread_join(handles[t], NULL);
+	}
 
-		if (state == KOML_PARSER_STATE_NONE && !is_whitespace(c)) {
-			printf("Unexpected token (line %llu: column %llu)\n  | ", line + 1, column + 1);
-			koml_printline(buffer, line, column);
-			printf("\n  | ");
-			koml_printcursor(column);
-			printf("\n");
-			return 9;
+	int ret = 0;
+	for (unsigned int t = 0; t < threads; ++t) {
+		pthread_mutex_destroy(&deques[t].lock);
+	}
+	pthread_mutex_destroy(&pool.lock);
+	pthread_cond_destroy(&pool.ready);
+	for (unsigned long long int i = 0; i < count; ++i) {
+		if (out_errors[i] != 0) {
+			ret = 2;
 		}
 	}
 
+	free(sized);
+	free(order);
+	free(tasks);
+	free(buffers);
+	free(lengths);
+	free(deques);
+	free(workers);
+	free(handles);
+	return ret;
+}
+
+struct koml_watch {
+	char * path;
+	char * name;
+	koml_load_options_t options;
+	koml_watch_callback_t callback;
+	void * user;
+	koml_table_t * table;
+	pthread_mutex_t lock;
+	pthread_t thread;
+	unsigned char started;
+	int notify;
+	int stop[2];
+};
+
+static int koml_internal_watch_load(koml_watch_t * watch, koml_table_t ** out_table) {
+	koml_table_t * table = malloc(sizeof(koml_table_t));
+	if (table == NULL) {
+		return 1;
+	}
+
+	int ret = koml_table_load_file(table, watch->path, &watch->options);
+	if (ret != 0) {
+		koml_table_destroy(table);
+		free(table);
+		return ret;
+	}
+
+	/* reloads keep the first table's seed, so handles re-validate against a new version without hashing their key again */
+	if (!(watch->options.flags & KOML_LOAD_SEED)) {
+		watch->options.flags |= KOML_LOAD_SEED;
+		watch->options.seed = table->seed;
+	}
+
+	table->flags |= KOML_TABLE_OWNS_SELF;
+	*out_table = table;
 	return 0;
 }
 
-koml_symbol_t * koml_table_symbol(koml_table_t * table, char * name) {
-	unsigned long long int hash = koml_internal_hash(name, strlen(name));
+#ifdef __linux__
+static void koml_internal_watch_reload(koml_watch_t * watch) {
+	koml_table_t * table = NULL;
+	int ret = koml_internal_watch_load(watch, &table);
+	if (ret == 0) {
+		pthread_mutex_lock(&watch->lock);
+		koml_table_t * old = watch->table;
+		watch->table = table;
+		pthread_mutex_unlock(&watch->lock);
+
+		koml_table_destroy(old);
+	}
 
-	for (unsigned long long int i = 0; i < table->length; ++i) {
-		if (table->hashes[i] == hash) {
-			return &table->symbols[i];
+	if (watch->callback != NULL) {
+		watch->callback(watch->user, table, ret);
+	}
+}
+
+/* watches the directory, not the file, so an editor's or deployer's rename over the path is seen too */
+static void * koml_internal_watch_thread(void * argument) {
+	koml_watch_t * watch = argument;
+	char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	unsigned char pending = 0;
+
+	for (;;) {
+		struct pollfd fds[2] = {
+			{ .fd = watch->notify, .events = POLLIN },
+			{ .fd = watch->stop[0], .events = POLLIN },
+		};
+
+		int ready = poll(fds, 2, (pending) ? KOML_WATCH_DEBOUNCE_MS : -1);
+		if (ready < 0 && errno != EINTR) {
+			break;
+		}
+
+		if (fds[1].revents != 0) {
+			break;
+		}
+
+		if (ready == 0 && pending) {
+			pending = 0;
+			koml_internal_watch_reload(watch);
+			continue;
+		}
+
+		if (ready <= 0 || !(fds[0].revents & POLLIN)) {
+			continue;
+		}
+
+		ssize_t length = read(watch->notify, events, sizeof(events));
+		for (ssize_t i = 0; i < length;) {
+			struct inotify_event * event = (struct inotify_event *) &events[i];
+			if (event->len > 0 && strcmp(event->name, watch->name) == 0) {
+				pending = 1;
+			}
+
+			i += sizeof(struct inotify_event) + event->len;
 		}
 	}
 
 	return NULL;
 }
 
-koml_symbol_t * koml_table_symbol_word(koml_table_t * table, char * name, unsigned long long int name_length) {
-	unsigned long long int hash = koml_internal_hash(name, name_length);
+int koml_watch(koml_watch_t ** out_watch, char * path, koml_load_options_t * options, koml_watch_callback_t callback, void * user) {
+	/* published tables are read by many threads at once; they are loaded in full rather than decoded under their readers */
+	if (options != NULL && (options->flags & KOML_LOAD_LAZY)) {
+		return 1;
+	}
 
-	for (unsigned long long int i = 0; i < table->length; ++i) {
-		if (table->hashes[i] == hash) {
-			return &table->symbols[i];
-		}
+	koml_watch_t * watch = calloc(1, sizeof(koml_watch_t));
+	if (watch == NULL) {
+		return 1;
 	}
 
-	return NULL;
+	watch->notify = -1;
+	watch->stop[0] = -1;
+	watch->stop[1] = -1;
+	watch->callback = callback;
+	watch->user = user;
+	if (options != NULL) {
+		watch->options = *options;
+	}
+
+	/* dirname and basename may modify their argument */
+	char * directory_copy = strdup(path);
+	char * name_copy = strdup(path);
+	watch->path = strdup(path);
+	if (directory_copy == NULL || name_copy == NULL || watch->path == NULL) {
+		free(directory_copy);
+		free(name_copy);
+		koml_watch_stop(watch);
+		return 1;
+	}
+	watch->name = strdup(basename(name_copy));
+	free(name_copy);
+
+	int ret = koml_internal_watch_load(watch, &watch->table);
+	if (ret != 0 || watch->name == NULL) {
+		free(directory_copy);
+		koml_watch_stop(watch);
+		return (ret != 0) ? ret : 1;
+	}
+
+	watch->notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch->notify < 0 || inotify_add_watch(watch->notify, dirname(directory_copy), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY) < 0 || pipe(watch->stop) != 0) {
+		free(directory_copy);
+		koml_watch_stop(watch);
+		return 20;
+	}
+	free(directory_copy);
+
+	pthread_mutex_init(&watch->lock, NULL);
+	if (pthread_create(&watch->thread, NULL, koml_internal_watch_thread, watch) != 0) {
+		pthread_mutex_destroy(&watch->lock);
+		koml_watch_stop(watch);
+		return 1;
+	}
+	watch->started = 1;
+
+	*out_watch = watch;
+	return 0;
+}
+#else
+int koml_watch(koml_watch_t ** out_watch, char * path, koml_load_options_t * options, koml_watch_callback_t callback, void * user) {
+	(void) out_watch;
+	(void) path;
+	(void) options;
+	(void) callback;
+	(void) user;
+	return 1;
 }
+#endif
 
-int koml_table_destroy(koml_table_t * table) {
-	if (table->hashes != NULL) {
-		free(table->hashes);
+koml_table_t * koml_watch_acquire(koml_watch_t * watch) {
+	pthread_mutex_lock(&watch->lock);
+	koml_table_t * table = koml_table_retain(watch->table);
+	pthread_mutex_unlock(&watch->lock);
+
+	return table;
+}
+
+int koml_watch_stop(koml_watch_t * watch) {
+	if (watch->started) {
+		char stop = 0;
+		while (write(watch->stop[1], &stop, 1) < 0 && errno == EINTR);
+		pthread_join(watch->thread, NULL);
+		pthread_mutex_destroy(&watch->lock);
 	}
 
-	if (table->symbols != NULL) {
-		free(table->symbols);
+	if (watch->table != NULL) {
+		koml_table_destroy(watch->table);
+	}
+
+	for (int i = 0; i < 2; ++i) {
+		if (watch->stop[i] >= 0) {
+			close(watch->stop[i]);
+		}
+	}
+	if (watch->notify >= 0) {
+		close(watch->notify);
 	}
 
+	free(watch->path);
+	free(watch->name);
+	free(watch);
 	return 0;
 }
+
+int koml_array_copy_as(koml_array_t * array, koml_element_enum type, void * out, unsigned long long int count) {
+	if (count > array->length) {
+		count = array->length;
+	}
+
+	return koml_internal_convert_elements(array->type, array->elements.voidptr, type, out, count);
+}
+
+void * koml_array_span(koml_array_t * array, koml_type_enum type, unsigned long long int * out_length) {
+	if (array->type != type) {
+		return NULL;
+	}
+
+	*out_length = array->length;
+	return array->elements.voidptr;
+}
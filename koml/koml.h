@@ -10,6 +10,14 @@ typedef enum koml_type {
 	KOML_TYPE_ARRAY = 5,
 } koml_type_enum;
 
+/* element types koml_array_copy_as can produce; I32 and F32 share their values with KOML_TYPE_INT and KOML_TYPE_FLOAT */
+typedef enum koml_element {
+	KOML_ELEMENT_I32 = 1,
+	KOML_ELEMENT_F32 = 2,
+	KOML_ELEMENT_I64 = 3,
+	KOML_ELEMENT_F64 = 4,
+} koml_element_enum;
+
 typedef struct koml_array {
 	unsigned long long int length;
 	unsigned long long int * strides;
@@ -21,6 +29,9 @@ typedef struct koml_array {
 		void * voidptr;
 	} elements;
 	koml_type_enum type;
+	/* aai, aaaf, ...: number of dimensions and their extents, outermost first. elements are row-major and length is the product of shape. 0 and NULL for a plain array */
+	unsigned int rank;
+	unsigned long long int * shape;
 } koml_array_t;
 
 typedef struct koml_symbol {
@@ -36,17 +47,235 @@ typedef struct koml_symbol {
 	} data;
 } koml_symbol_t;
 
+typedef struct koml_lazy koml_lazy_t;
+typedef struct koml_telemetry koml_telemetry_t;
+
 typedef struct koml_table {
 	koml_symbol_t * symbols;
 	unsigned long long int * hashes;
 	unsigned long long int length;
+	char * source;
+	koml_lazy_t * lazy;
+	struct koml_table * base;
+	unsigned long long int refcount;
+	unsigned long long int * index;
+	unsigned long long int index_mask;
+	unsigned int flags;
+	/* set by koml_table_freeze: one read-only mapping holding every symbol, name and value */
+	char * block;
+	unsigned long long int block_size;
+	/* keys are hashed with koml_hash(name, length, seed); random per table unless set through KOML_LOAD_SEED */
+	unsigned long long int seed;
+	/* sampled lookup counts per slot, set by koml_table_telemetry */
+	koml_telemetry_t * telemetry;
+	/* process-wide number of this version of the table; changes whenever symbols may move (load, freeze, relayout) */
+	unsigned long long int generation;
 } koml_table_t;
 
+/*
+ * a key resolved to a slot of one table generation. reads on that generation are an index; on any other table (e.g. after a
+ * reload) the handle is re-validated with its stored hash and updated in place, so each thread keeps its own. name must outlive it
+ */
+typedef struct koml_handle {
+	unsigned long long int slot;
+	unsigned long long int generation;
+	unsigned long long int hash;
+	char * name;
+	unsigned long long int name_length;
+} koml_handle_t;
+
+typedef enum koml_load_flags {
+	/* only record value ranges; decode on first lookup (once, under a process-wide lock, so lookups stay thread-safe). the buffer must outlive the table */
+	KOML_LOAD_LAZY = 1 << 0,
+	/* hash keys with options->seed instead of a random one; overlays always use their base's seed */
+	KOML_LOAD_SEED = 1 << 1,
+	/* map a saved image from options->cache when one exists for this exact buffer, else parse and save one. the table comes back frozen (or the freeze error), rehashed with a fresh seed unless KOML_LOAD_SEED is set */
+	KOML_LOAD_CACHE = 1 << 2,
+	/* fail with 21 on a string value that is not valid utf-8; the error points at the first byte of the bad sequence */
+	KOML_LOAD_UTF8 = 1 << 3,
+} koml_load_flags_enum;
+
+typedef struct koml_load_options {
+	unsigned int flags;
+	/* symbols missing from the loaded table are looked up here; retained until the table is destroyed */
+	koml_table_t * base;
+	unsigned long long int seed;
+	/* cache directory for KOML_LOAD_CACHE; only trusted processes should be able to write to it */
+	char * cache;
+} koml_load_options_t;
+
+/*
+ * output target for koml_table_write
+ * callback == NULL, buffer != NULL: write into buffer, fail with 2 once capacity is exceeded
+ * callback == NULL, buffer == NULL: only count the bytes into length
+ * callback != NULL: stage writes in buffer (may be NULL with capacity 0) and flush through callback
+ */
+typedef int (*koml_sink_callback_t)(void * user, char * data, unsigned long long int length);
+
+typedef struct koml_sink {
+	char * buffer;
+	unsigned long long int capacity;
+	unsigned long long int length;
+	koml_sink_callback_t callback;
+	void * user;
+} koml_sink_t;
+
+/* growable output: a sink with callback = koml_buffer_append and user = the buffer collects everything written. free data when done */
+typedef struct koml_buffer {
+	char * data;
+	unsigned long long int length;
+	unsigned long long int capacity;
+} koml_buffer_t;
+
+typedef enum koml_diff {
+	KOML_DIFF_ADDED = 1,
+	KOML_DIFF_REMOVED = 2,
+	KOML_DIFF_TYPE_CHANGED = 3,
+	KOML_DIFF_VALUE_CHANGED = 4,
+	KOML_DIFF_ELEMENT_ADDED = 5,
+	KOML_DIFF_ELEMENT_REMOVED = 6,
+	KOML_DIFF_ELEMENT_CHANGED = 7,
+} koml_diff_enum;
+
+/* a or b is NULL for added/removed symbols; element is the array index for KOML_DIFF_ELEMENT_*. non-zero stops the walk */
+typedef int (*koml_diff_callback_t)(void * user, koml_diff_enum kind, koml_symbol_t * a, koml_symbol_t * b, unsigned long long int element);
+/* any of the three may be NULL (symbol absent); returns the symbol to keep, or NULL to drop it */
+typedef koml_symbol_t * (*koml_merge_callback_t)(void * user, koml_symbol_t * base, koml_symbol_t * ours, koml_symbol_t * theirs);
+
+/* count is estimated: samples times the sampling rate */
+typedef struct koml_hot_key {
+	koml_symbol_t * symbol;
+	unsigned long long int count;
+} koml_hot_key_t;
+
+/* a named shm channel that frozen tables are published through; see koml_shared_open */
+typedef struct koml_shared koml_shared_t;
+
+typedef struct koml_watch koml_watch_t;
+/* runs on the watch thread after each reload: the newly published table and 0, or NULL and the load error (the previous table stays published) */
+typedef void (*koml_watch_callback_t)(void * user, koml_table_t * table, int code);
+
+typedef enum koml_schema_flags {
+	/* a missing key is not a violation */
+	KOML_SCHEMA_OPTIONAL = 1 << 0,
+	/* ints and floats, and every element of int/float arrays, must lie in [min, max] */
+	KOML_SCHEMA_CHECK_RANGE = 1 << 1,
+	/* arrays (total element count) and strings (bytes) must have a length in [min_length, max_length] */
+	KOML_SCHEMA_CHECK_LENGTH = 1 << 2,
+} koml_schema_flags_enum;
+
+/* one key of a schema; name is "section:name" like koml_table_symbol takes */
+typedef struct koml_schema_entry {
+	char * name;
+	koml_type_enum type;
+	/* arrays only: element type and rank (0 for a plain array, else 2 or more) */
+	koml_type_enum array_type;
+	unsigned int rank;
+	unsigned int flags;
+	double min;
+	double max;
+	unsigned long long int min_length;
+	unsigned long long int max_length;
+} koml_schema_entry_t;
+
+typedef enum koml_schema_violation {
+	KOML_SCHEMA_MISSING = 1,
+	/* type, array element type or rank differ */
+	KOML_SCHEMA_WRONG_TYPE = 2,
+	KOML_SCHEMA_OUT_OF_RANGE = 3,
+	KOML_SCHEMA_BAD_LENGTH = 4,
+	/* a lazy value that failed to decode */
+	KOML_SCHEMA_BAD_VALUE = 5,
+} koml_schema_violation_enum;
+
+/* entry indexes the schema's entries; element is the first array element out of range. name lives as long as the schema */
+typedef struct koml_schema_error {
+	koml_schema_violation_enum kind;
+	unsigned long long int entry;
+	char * name;
+	unsigned long long int element;
+} koml_schema_error_t;
+
+typedef struct koml_schema koml_schema_t;
+
+/* code matches the value koml_table_load would return; line and column are 1-based */
+typedef struct koml_error {
+	int code;
+	unsigned long long int line;
+	unsigned long long int column;
+	char * message;
+} koml_error_t;
+
 void koml_symbol_print(koml_symbol_t * symbol);
 void koml_table_print(koml_table_t * table);
+/* writes every symbol a lookup would find; for an overlay that includes the base symbols it does not shadow */
+int koml_table_write(koml_table_t * table, koml_sink_t * sink);
+unsigned long long int koml_table_write_length(koml_table_t * table);
+/* the table as one object with a nested object per section component; same symbols, sink and return codes as koml_table_write */
+int koml_table_to_json(koml_table_t * table, koml_sink_t * sink);
+int koml_table_to_msgpack(koml_table_t * table, koml_sink_t * sink);
+int koml_buffer_append(void * user, char * data, unsigned long long int length);
 int koml_table_load(koml_table_t * out_table, char * buffer, unsigned long long int buffer_length);
+int koml_table_load_ex(koml_table_t * out_table, char * buffer, unsigned long long int buffer_length, koml_load_options_t * options);
+int koml_validate(char * buffer, unsigned long long int buffer_length, koml_error_t * error);
+int koml_table_load_file(koml_table_t * out_table, char * path, koml_load_options_t * options);
+/* reads count files asynchronously (io_uring, else pread threads) and parses them on threads workers; threads == 0 uses every online cpu. returns 2 if any out_errors[i] != 0 */
+int koml_load_many(char ** paths, unsigned long long int count, koml_table_t * out_tables, int * out_errors, unsigned int threads);
+/* copies min(count, length) elements of an int or float array into out as type; 2 if the array is not numeric */
+int koml_array_copy_as(koml_array_t * array, koml_element_enum type, void * out, unsigned long long int count);
+/* the elements themselves when the array holds type, else NULL */
+void * koml_array_span(koml_array_t * array, koml_type_enum type, unsigned long long int * out_length);
 koml_symbol_t * koml_table_symbol(koml_table_t * table, char * name);
 koml_symbol_t * koml_table_symbol_word(koml_table_t * table, char * name, unsigned long long int name_length);
+/* hash must be koml_hash(name, name_length, table->seed); lets hot lookups hash their key once */
+koml_symbol_t * koml_table_symbol_hash(koml_table_t * table, char * name, unsigned long long int name_length, unsigned long long int hash);
+/* NULL with 0 in out_error for a missing key; a lazy value that failed to decode gives NULL and the error its decode returned */
+koml_symbol_t * koml_table_symbol_status(koml_table_t * table, char * name, unsigned long long int name_length, int * out_error);
+unsigned long long int koml_hash(char * name, unsigned long long int length, unsigned long long int seed);
+/* resolves name once; missing keys give a handle that reads as NULL until a table version holds them */
+koml_handle_t koml_table_resolve(koml_table_t * table, char * name);
+koml_symbol_t * koml_table_symbol_handle(koml_table_t * table, koml_handle_t * handle);
+koml_table_t * koml_table_retain(koml_table_t * table);
+int koml_table_overlay(koml_table_t * out_table, koml_table_t * base, char * buffer, unsigned long long int buffer_length);
+/*
+ * moves every symbol into one read-only block, grouped by section; lazy values are decoded first (2 if one fails).
+ * symbol and string pointers obtained before freezing are invalid afterwards, look them up again
+ */
+int koml_table_freeze(koml_table_t * table);
+/*
+ * samples about 1 in rate successful lookups into per-slot counters; rate 0 turns sampling off, enabling again resets the counts.
+ * like relayout, only call while no other thread reads the table
+ */
+int koml_table_telemetry(koml_table_t * table, unsigned int rate);
+/* writes up to capacity sampled symbols, hottest first; returns how many were written */
+unsigned long long int koml_table_hot_keys(koml_table_t * table, koml_hot_key_t * out, unsigned long long int capacity);
+/*
+ * moves the count hottest sampled symbols (0: all of them) to the front of the table and the index; symbol pointers are invalid afterwards.
+ * 1 for a table from koml_shared_attach that maps the published image directly, its storage cannot be rewritten
+ */
+int koml_table_relayout(koml_table_t * table, unsigned long long int count);
 int koml_table_destroy(koml_table_t * table);
+/* loads path, then reloads it on a background thread whenever it changes (including renames over it) and publishes each table that parses. 1 with KOML_LOAD_LAZY */
+int koml_watch(koml_watch_t ** out_watch, char * path, koml_load_options_t * options, koml_watch_callback_t callback, void * user);
+/* the currently published table, retained; release it with koml_table_destroy */
+koml_table_t * koml_watch_acquire(koml_watch_t * watch);
+int koml_watch_stop(koml_watch_t * watch);
+/* opens the shm channel name (e.g. "/service"), creating it if needed; 20 when it cannot be opened */
+int koml_shared_open(koml_shared_t ** out_shared, char * name);
+/* freezes table and publishes a copy of it as the next generation; returns that generation through out_generation (may be NULL). 1 if the frozen table does not fit its 4 GiB address slot */
+int koml_shared_publish(koml_shared_t * shared, koml_table_t * table, unsigned long long int * out_generation);
+/* newest published generation, 0 before the first publish; a single load, cheap enough to check on every request */
+unsigned long long int koml_shared_generation(koml_shared_t * shared);
+/* maps the newest generation read-only into out_table (20 if none is published); it stays valid across publishes until koml_table_destroy */
+int koml_shared_attach(koml_shared_t * shared, koml_table_t * out_table, unsigned long long int * out_generation);
+/* unmaps the channel; with unpublish set also removes its name and newest generation (attached tables stay valid) */
+int koml_shared_close(koml_shared_t * shared, unsigned char unpublish);
+/* copies entries and hashes their keys with seed (2 for an invalid entry); tables loaded with KOML_LOAD_SEED and the same seed are checked without hashing */
+int koml_schema_compile(koml_schema_t ** out_schema, koml_schema_entry_t * entries, unsigned long long int count, unsigned long long int seed);
+/* checks every entry in one pass; returns how many were violated and writes the first capacity of them into errors */
+unsigned long long int koml_schema_check(koml_schema_t * schema, koml_table_t * table, koml_schema_error_t * errors, unsigned long long int capacity);
+int koml_schema_destroy(koml_schema_t * schema);
+int koml_table_diff(koml_table_t * a, koml_table_t * b, koml_diff_callback_t callback, void * user);
+int koml_table_merge(koml_table_t * out_table, koml_table_t * base, koml_table_t * ours, koml_table_t * theirs, koml_merge_callback_t conflict, void * user);
 
 #endif
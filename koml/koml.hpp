@@ -0,0 +1,266 @@
+#ifndef KRISVERS_KOML_HPP
+#define KRISVERS_KOML_HPP
+
+/* header-only c++20 wrapper around koml.h */
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+
+extern "C" {
+#include "koml.h"
+}
+
+/* tables loaded through koml::table hash with this seed so literal keys can be hashed at compile time. it is the key to the index, so every build picks its own */
+#ifndef KOML_SEED
+#error "define KOML_SEED to a private 64-bit value for this build, e.g. -DKOML_SEED=0x$(od -An -N8 -tx8 /dev/urandom | tr -d ' ')ULL"
+#endif
+
+namespace koml {
+
+inline constexpr unsigned long long int seed = KOML_SEED;
+
+namespace detail {
+
+__extension__ typedef unsigned __int128 uint128;
+
+constexpr unsigned long long int mix(unsigned long long int a, unsigned long long int b) {
+	uint128 product = (uint128) a * b;
+	return (unsigned long long int) product ^ (unsigned long long int) (product >> 64);
+}
+
+/* byte-wise little-endian reads: same values as koml_wyread8/koml_wyread4 on the targets we build for */
+constexpr unsigned long long int read(const char * p, unsigned int count) {
+	unsigned long long int value = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		value |= (unsigned long long int) (unsigned char) p[i] << (i * 8);
+	}
+
+	return value;
+}
+
+inline constexpr unsigned long long int secret[] = { 0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL };
+
+}
+
+/* constexpr mirror of koml_hash */
+constexpr unsigned long long int hash(std::string_view name, unsigned long long int hash_seed) {
+	const char * p = name.data();
+	unsigned long long int length = name.size();
+	unsigned long long int a = 0;
+	unsigned long long int b = 0;
+
+	hash_seed ^= detail::mix(hash_seed ^ detail::secret[0], detail::secret[1]);
+	if (length <= 16) {
+		if (length >= 4) {
+			unsigned long long int shift = (length >> 3) << 2;
+			a = (detail::read(p, 4) << 32) | detail::read(p + shift, 4);
+			b = (detail::read(p + length - 4, 4) << 32) | detail::read(p + length - 4 - shift, 4);
+		} else if (length > 0) {
+			a = ((unsigned long long int) (unsigned char) p[0] << 16) | ((unsigned long long int) (unsigned char) p[length >> 1] << 8) | (unsigned char) p[length - 1];
+		}
+	} else {
+		unsigned long long int i = length;
+		if (i > 48) {
+			unsigned long long int see1 = hash_seed;
+			unsigned long long int see2 = hash_seed;
+			do {
+				hash_seed = detail::mix(detail::read(p, 8) ^ detail::secret[1], detail::read(p + 8, 8) ^ hash_seed);
+				see1 = detail::mix(detail::read(p + 16, 8) ^ detail::secret[2], detail::read(p + 24, 8) ^ see1);
+				see2 = detail::mix(detail::read(p + 32, 8) ^ detail::secret[3], detail::read(p + 40, 8) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			hash_seed ^= see1 ^ see2;
+		}
+
+		while (i > 16) {
+			hash_seed = detail::mix(detail::read(p, 8) ^ detail::secret[1], detail::read(p + 8, 8) ^ hash_seed);
+			p += 16;
+			i -= 16;
+		}
+
+		a = detail::read(p + i - 16, 8);
+		b = detail::read(p + i - 8, 8);
+	}
+
+	detail::uint128 product = (detail::uint128) (a ^ detail::secret[1]) * (b ^ hash_seed);
+	a = (unsigned long long int) product;
+	b = (unsigned long long int) (product >> 64);
+	return detail::mix(a ^ detail::secret[0] ^ length, b ^ detail::secret[1]);
+}
+
+/* a key hashed at compile time: "section:name"_key */
+struct key {
+	std::string_view name;
+	unsigned long long int hash;
+
+	consteval key(std::string_view key_name) : name(key_name), hash(koml::hash(key_name, koml::seed)) {}
+};
+
+namespace literals {
+
+consteval key operator""_key(const char * name, std::size_t length) {
+	return key(std::string_view(name, length));
+}
+
+}
+
+namespace detail {
+
+template <typename T> struct value_of;
+
+template <> struct value_of<int> {
+	static constexpr koml_type_enum type = KOML_TYPE_INT;
+	static int get(const koml_symbol_t * symbol) { return symbol->data.i32; }
+};
+
+template <> struct value_of<float> {
+	static constexpr koml_type_enum type = KOML_TYPE_FLOAT;
+	static float get(const koml_symbol_t * symbol) { return symbol->data.f32; }
+};
+
+template <> struct value_of<bool> {
+	static constexpr koml_type_enum type = KOML_TYPE_BOOLEAN;
+	static bool get(const koml_symbol_t * symbol) { return symbol->data.boolean != 0; }
+};
+
+template <> struct value_of<std::string_view> {
+	static constexpr koml_type_enum type = KOML_TYPE_STRING;
+	static std::string_view get(const koml_symbol_t * symbol) { return symbol->data.string; }
+};
+
+template <typename E, koml_type_enum T> struct array_of {
+	static constexpr koml_type_enum type = KOML_TYPE_ARRAY;
+	static constexpr koml_type_enum element_type = T;
+	static std::span<E> get(const koml_symbol_t * symbol) { return std::span<E>((E *) symbol->data.array.elements.voidptr, symbol->data.array.length); }
+};
+
+template <> struct value_of<std::span<const int>> : array_of<const int, KOML_TYPE_INT> {};
+template <> struct value_of<std::span<const float>> : array_of<const float, KOML_TYPE_FLOAT> {};
+template <> struct value_of<std::span<const unsigned char>> : array_of<const unsigned char, KOML_TYPE_BOOLEAN> {};
+template <> struct value_of<std::span<char * const>> : array_of<char * const, KOML_TYPE_STRING> {};
+
+template <typename T> concept array_value = requires { value_of<T>::element_type; };
+
+}
+
+/* owns one koml_table_t; move-only. the table lives on the heap so moves never invalidate symbol pointers */
+class table {
+public:
+	table() = default;
+	table(const table &) = delete;
+	table & operator=(const table &) = delete;
+	table(table && other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+	table & operator=(table && other) noexcept {
+		if (this != &other) {
+			reset();
+			handle = std::exchange(other.handle, nullptr);
+		}
+
+		return *this;
+	}
+
+	~table() {
+		reset();
+	}
+
+	/* same return codes as koml_table_load_ex; KOML_LOAD_LAZY needs buffer to outlive the table */
+	int load(std::string_view buffer, unsigned int flags = 0) {
+		return open([&](koml_table_t * out, koml_load_options_t * options) {
+			return koml_table_load_ex(out, (char *) buffer.data(), buffer.size(), options);
+		}, flags);
+	}
+
+	int load_file(const char * path, unsigned int flags = 0) {
+		return open([&](koml_table_t * out, koml_load_options_t * options) {
+			return koml_table_load_file(out, (char *) path, options);
+		}, flags);
+	}
+
+	int freeze() {
+		return (handle != nullptr) ? koml_table_freeze(handle) : 1;
+	}
+
+	const koml_symbol_t * symbol(key k) const {
+		if (handle == nullptr) {
+			return nullptr;
+		}
+
+		unsigned long long int h = (handle->seed == koml::seed) ? k.hash : koml_hash((char *) k.name.data(), k.name.size(), handle->seed);
+		return koml_table_symbol_hash(handle, (char *) k.name.data(), k.name.size(), h);
+	}
+
+	const koml_symbol_t * symbol(std::string_view name) const {
+		return (handle != nullptr) ? koml_table_symbol_word(handle, (char *) name.data(), name.size()) : nullptr;
+	}
+
+	/* empty if the key is missing or holds another type; T is int, float, bool, std::string_view or a std::span of const int, const float, const unsigned char or char * const */
+	template <typename T> std::optional<T> get(key k) const {
+		return value<T>(symbol(k));
+	}
+
+	template <typename T> std::optional<T> get(std::string_view name) const {
+		return value<T>(symbol(name));
+	}
+
+	koml_table_t * c_table() const {
+		return handle;
+	}
+
+	explicit operator bool() const {
+		return handle != nullptr;
+	}
+
+private:
+	koml_table_t * handle = nullptr;
+
+	template <typename F> int open(F && load_into, unsigned int flags) {
+		std::unique_ptr<koml_table_t> loaded(new koml_table_t());
+		koml_load_options_t options = {};
+		options.flags = flags | KOML_LOAD_SEED;
+		options.seed = koml::seed;
+
+		int ret = load_into(loaded.get(), &options);
+		if (ret != 0) {
+			/* a failed load keeps whatever it parsed up to the error */
+			koml_table_destroy(loaded.get());
+			return ret;
+		}
+
+		reset();
+		handle = loaded.release();
+		return 0;
+	}
+
+	void reset() {
+		if (handle != nullptr) {
+			koml_table_destroy(handle);
+			delete handle;
+			handle = nullptr;
+		}
+	}
+
+	template <typename T> static std::optional<T> value(const koml_symbol_t * symbol) {
+		using traits = detail::value_of<T>;
+		if (symbol == nullptr || symbol->type != traits::type) {
+			return std::nullopt;
+		}
+
+		if constexpr (detail::array_value<T>) {
+			if (symbol->data.array.type != traits::element_type) {
+				return std::nullopt;
+			}
+		}
+
+		return traits::get(symbol);
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,634 @@
+/* cpython extension: `make python` builds _koml next to koml.py */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "koml.h"
+
+typedef struct koml_py_table {
+	PyObject_HEAD
+	koml_table_t * table;
+	/* lazy tables decode from the caller's buffer, so it stays held until the table goes */
+	Py_buffer source;
+	unsigned char holds_source;
+} koml_py_table_t;
+
+/* a numeric array of a table, exposed through the buffer protocol; keeps its table alive */
+typedef struct koml_py_array {
+	PyObject_HEAD
+	koml_py_table_t * owner;
+	koml_array_t * array;
+	Py_ssize_t shape[8];
+	Py_ssize_t strides[8];
+	int exports;
+} koml_py_array_t;
+
+static PyObject * koml_py_error;
+static PyTypeObject koml_py_table_type;
+static PyTypeObject koml_py_array_type;
+
+/* args are (code, message, line, column); line and column are 0 when unknown */
+static PyObject * koml_py_raise(int code, koml_error_t * error) {
+	PyObject * value = (error != NULL && error->code == code && error->message != NULL)
+		? Py_BuildValue("(isKK)", code, error->message, error->line, error->column)
+		: Py_BuildValue("(isii)", code, "failed to load table", 0, 0);
+	if (value != NULL) {
+		PyErr_SetObject(koml_py_error, value);
+		Py_DECREF(value);
+	}
+	return NULL;
+}
+
+static PyObject * koml_py_string(char * string) {
+	return PyUnicode_DecodeUTF8(string, strlen(string), "surrogateescape");
+}
+
+static PyObject * koml_py_array_new(koml_py_table_t * owner, koml_array_t * array) {
+	koml_py_array_t * self = PyObject_New(koml_py_array_t, &koml_py_array_type);
+	if (self == NULL) {
+		return NULL;
+	}
+
+	Py_INCREF(owner);
+	self->owner = owner;
+	self->array = array;
+	self->exports = 0;
+
+	unsigned int rank = (array->shape != NULL) ? array->rank : 1;
+	for (unsigned int i = 0; i < rank; ++i) {
+		self->shape[i] = (array->shape != NULL) ? (Py_ssize_t) array->shape[i] : (Py_ssize_t) array->length;
+	}
+
+	Py_ssize_t stride = (array->type == KOML_TYPE_FLOAT) ? sizeof(float) : sizeof(int);
+	for (unsigned int i = rank; i-- > 0;) {
+		self->strides[i] = stride;
+		stride *= self->shape[i];
+	}
+
+	return (PyObject *) self;
+}
+
+static PyObject * koml_py_element(koml_array_t * array, unsigned long long int i) {
+	switch (array->type) {
+		case KOML_TYPE_INT:
+			return PyLong_FromLong(array->elements.i32[i]);
+		case KOML_TYPE_FLOAT:
+			return PyFloat_FromDouble(array->elements.f32[i]);
+		case KOML_TYPE_STRING:
+			return koml_py_string(array->elements.string[i]);
+		default:
+			return PyBool_FromLong(array->elements.boolean[i]);
+	}
+}
+
+/* numeric arrays come back as koml.Array (zero-copy through the buffer protocol), string and boolean arrays as lists */
+static PyObject * koml_py_value(koml_py_table_t * owner, koml_symbol_t * symbol) {
+	switch (symbol->type) {
+		case KOML_TYPE_INT:
+			return PyLong_FromLong(symbol->data.i32);
+		case KOML_TYPE_FLOAT:
+			return PyFloat_FromDouble(symbol->data.f32);
+		case KOML_TYPE_STRING:
+			return koml_py_string(symbol->data.string);
+		case KOML_TYPE_BOOLEAN:
+			return PyBool_FromLong(symbol->data.boolean);
+		case KOML_TYPE_ARRAY:
+			break;
+		default:
+			PyErr_Format(PyExc_TypeError, "unhandled type: %d", symbol->type);
+			return NULL;
+	}
+
+	koml_array_t * array = &symbol->data.array;
+	if (array->type == KOML_TYPE_INT || array->type == KOML_TYPE_FLOAT) {
+		return koml_py_array_new(owner, array);
+	}
+
+	PyObject * list = PyList_New(array->length);
+	if (list == NULL) {
+		return NULL;
+	}
+
+	for (unsigned long long int i = 0; i < array->length; ++i) {
+		PyObject * item = koml_py_element(array, i);
+		if (item == NULL) {
+			Py_DECREF(list);
+			return NULL;
+		}
+		PyList_SET_ITEM(list, i, item);
+	}
+
+	return list;
+}
+/* NULL and out_missing for a missing key; any other NULL has koml.Error (a lazy value that failed to decode) or a unicode error set */
+/* NULL with out_missing set for a missing key; otherwise NULL raised koml.Error (a lazy value that failed to decode) or a unicode error */
+static koml_symbol_t * koml_py_lookup(koml_py_table_t * self, PyObject * key, unsigned char * out_missing) {
+	Py_ssize_t length = 0;
+	const char * name = PyUnicode_AsUTF8AndSize(key, &length);
+	*out_missing = 0;
+	if (name == NULL) {
+		return NULL;
+	}
+
+	int error = 0;
+	koml_symbol_t * symbol = koml_table_symbol_status(self->table, (char *) name, length, &error);
+	if (symbol == NULL && error != 0) {
+		koml_error_t failure = { .code = error, .message = "failed to decode value" };
+		koml_py_raise(error, &failure);
+	}
+	*out_missing = (symbol == NULL && error == 0);
+	return symbol;
+}
+
+static PyObject * koml_py_table_subscript(koml_py_table_t * self, PyObject * key) {
+	unsigned char missing;
+	koml_symbol_t * symbol = koml_py_lookup(self, key, &missing);
+	if (symbol == NULL && missing) {
+		PyErr_SetObject(PyExc_KeyError, key);
+	}
+	return (symbol != NULL) ? koml_py_value(self, symbol) : NULL;
+}
+
+static int koml_py_table_contains(koml_py_table_t * self, PyObject * key) {
+	Py_ssize_t length = 0;
+	const char * name = PyUnicode_AsUTF8AndSize(key, &length);
+	if (name == NULL) {
+		return -1;
+	}
+
+	/* a lazy value that failed to decode is still there */
+	int error = 0;
+	return koml_table_symbol_status(self->table, (char *) name, length, &error) != NULL || error != 0;
+}
+
+static Py_ssize_t koml_py_table_length(koml_py_table_t * self) {
+	return (Py_ssize_t) self->table->length;
+}
+
+static PyObject * koml_py_table_value(koml_py_table_t * self, PyObject * key) {
+	return koml_py_table_subscript(self, key);
+}
+
+static PyObject * koml_py_table_get(koml_py_table_t * self, PyObject * args) {
+	PyObject * key;
+	PyObject * fallback = Py_None;
+	if (!PyArg_ParseTuple(args, "U|O:get", &key, &fallback)) {
+		return NULL;
+	}
+
+	unsigned char missing;
+	koml_symbol_t * symbol = koml_py_lookup(self, key, &missing);
+	if (symbol == NULL) {
+		if (!missing) {
+			return NULL;
+		}
+
+		Py_INCREF(fallback);
+		return fallback;
+	}
+	return koml_py_value(self, symbol);
+}
+
+static PyObject * koml_py_table_keys(koml_py_table_t * self, PyObject * unused) {
+	(void) unused;
+	PyObject * keys = PyList_New(self->table->length);
+	if (keys == NULL) {
+		return NULL;
+	}
+
+	for (unsigned long long int i = 0; i < self->table->length; ++i) {
+		PyObject * key = koml_py_string(self->table->symbols[i].name);
+		if (key == NULL) {
+			Py_DECREF(keys);
+			return NULL;
+		}
+		PyList_SET_ITEM(keys, i, key);
+	}
+
+	return keys;
+}
+
+static PyObject * koml_py_table_export(koml_py_table_t * self, int (*export)(koml_table_t *, koml_sink_t *)) {
+	char stage[4096];
+	koml_buffer_t out = { 0 };
+	koml_sink_t sink = { .buffer = stage, .capacity = sizeof(stage), .callback = koml_buffer_append, .user = &out };
+
+	/* a lazy table (the one kind that holds its source) decodes values as the export reaches them, so it keeps the gil like a lookup does */
+	int ret;
+	if (self->holds_source) {
+		ret = export(self->table, &sink);
+	} else {
+		Py_BEGIN_ALLOW_THREADS
+		ret = export(self->table, &sink);
+		Py_END_ALLOW_THREADS
+	}
+
+	PyObject * bytes = (ret == 0) ? PyBytes_FromStringAndSize(out.data, out.length) : koml_py_raise(ret, NULL);
+	free(out.data);
+	return bytes;
+}
+
+static PyObject * koml_py_table_to_json(koml_py_table_t * self, PyObject * unused) {
+	(void) unused;
+	return koml_py_table_export(self, koml_table_to_json);
+}
+
+static PyObject * koml_py_table_to_msgpack(koml_py_table_t * self, PyObject * unused) {
+	(void) unused;
+	return koml_py_table_export(self, koml_table_to_msgpack);
+}
+
+static void koml_py_table_dealloc(koml_py_table_t * self) {
+	if (self->table != NULL) {
+		koml_table_destroy(self->table);
+		free(self->table);
+	}
+	if (self->holds_source) {
+		PyBuffer_Release(&self->source);
+	}
+	Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyMethodDef koml_py_table_methods[] = {
+	{ "value", (PyCFunction) koml_py_table_value, METH_O, "value(key) -> the value of key; KeyError when missing" },
+	{ "get", (PyCFunction) koml_py_table_get, METH_VARARGS, "get(key, default=None)" },
+	{ "keys", (PyCFunction) koml_py_table_keys, METH_NOARGS, "every symbol name, as \"section:name\"" },
+	{ "to_json", (PyCFunction) koml_py_table_to_json, METH_NOARGS, "the table as json bytes" },
+	{ "to_msgpack", (PyCFunction) koml_py_table_to_msgpack, METH_NOARGS, "the table as messagepack bytes" },
+	{ NULL, NULL, 0, NULL },
+};
+
+static PyMappingMethods koml_py_table_mapping = {
+	.mp_length = (lenfunc) koml_py_table_length,
+	.mp_subscript = (binaryfunc) koml_py_table_subscript,
+};
+
+static PySequenceMethods koml_py_table_sequence = {
+	.sq_contains = (objobjproc) koml_py_table_contains,
+};
+
+static PyTypeObject koml_py_table_type = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "_koml.Table",
+	.tp_basicsize = sizeof(koml_py_table_t),
+	.tp_dealloc = (destructor) koml_py_table_dealloc,
+	.tp_as_mapping = &koml_py_table_mapping,
+	.tp_as_sequence = &koml_py_table_sequence,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = "a loaded koml table; look symbols up with table[\"section:name\"]",
+	.tp_methods = koml_py_table_methods,
+};
+
+static int koml_py_array_getbuffer(koml_py_array_t * self, Py_buffer * view, int flags) {
+	koml_array_t * array = self->array;
+	if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+		PyErr_SetString(PyExc_BufferError, "koml arrays are read-only");
+		return -1;
+	}
+
+	unsigned int rank = (array->shape != NULL) ? array->rank : 1;
+	Py_INCREF(self);
+	view->obj = (PyObject *) self;
+	view->buf = array->elements.voidptr;
+	view->itemsize = (array->type == KOML_TYPE_FLOAT) ? sizeof(float) : sizeof(int);
+	view->len = (Py_ssize_t) array->length * view->itemsize;
+	view->readonly = 1;
+	view->format = ((flags & PyBUF_FORMAT) == PyBUF_FORMAT) ? ((array->type == KOML_TYPE_FLOAT) ? "f" : "i") : NULL;
+	view->ndim = rank;
+	view->shape = ((flags & PyBUF_ND) == PyBUF_ND) ? self->shape : NULL;
+	view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? self->strides : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	++self->exports;
+	return 0;
+}
+
+static void koml_py_array_releasebuffer(koml_py_array_t * self, Py_buffer * view) {
+	(void) view;
+	--self->exports;
+}
+
+static Py_ssize_t koml_py_array_length(koml_py_array_t * self) {
+	return self->shape[0];
+}
+
+static PyObject * koml_py_array_tolist(koml_py_array_t * self, PyObject * unused) {
+	(void) unused;
+	PyObject * view = PyMemoryView_FromObject((PyObject *) self);
+	if (view == NULL) {
+		return NULL;
+	}
+
+	PyObject * list = PyObject_CallMethod(view, "tolist", NULL);
+	Py_DECREF(view);
+	return list;
+}
+
+static PyObject * koml_py_array_get_shape(koml_py_array_t * self, void * closure) {
+	(void) closure;
+	unsigned int rank = (self->array->shape != NULL) ? self->array->rank : 1;
+	PyObject * shape = PyTuple_New(rank);
+	if (shape == NULL) {
+		return NULL;
+	}
+
+	for (unsigned int i = 0; i < rank; ++i) {
+		PyTuple_SET_ITEM(shape, i, PyLong_FromSsize_t(self->shape[i]));
+	}
+	return shape;
+}
+
+static void koml_py_array_dealloc(koml_py_array_t * self) {
+	Py_DECREF(self->owner);
+	PyObject_Free(self);
+}
+
+static PyBufferProcs koml_py_array_buffer = {
+	.bf_getbuffer = (getbufferproc) koml_py_array_getbuffer,
+	.bf_releasebuffer = (releasebufferproc) koml_py_array_releasebuffer,
+};
+
+static PySequenceMethods koml_py_array_sequence = {
+	.sq_length = (lenfunc) koml_py_array_length,
+};
+
+static PyMethodDef koml_py_array_methods[] = {
+	{ "tolist", (PyCFunction) koml_py_array_tolist, METH_NOARGS, "the elements as (nested) lists" },
+	{ NULL, NULL, 0, NULL },
+};
+
+static PyGetSetDef koml_py_array_getset[] = {
+	{ "shape", (getter) koml_py_array_get_shape, NULL, "extent of each dimension", NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
+
+static PyTypeObject koml_py_array_type = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "_koml.Array",
+	.tp_basicsize = sizeof(koml_py_array_t),
+	.tp_dealloc = (destructor) koml_py_array_dealloc,
+	.tp_as_sequence = &koml_py_array_sequence,
+	.tp_as_buffer = &koml_py_array_buffer,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = "read-only view of an int or float array (memoryview/numpy.asarray wrap it without copying)",
+	.tp_methods = koml_py_array_methods,
+	.tp_getset = koml_py_array_getset,
+};
+
+/* the parse runs without the gil; the source buffer is held (bytes are immutable, other exporters are locked) until it ends */
+static PyObject * koml_py_loads(PyObject * module, PyObject * args, PyObject * kwargs) {
+	(void) module;
+	static char * keywords[] = { "data", "flags", NULL };
+	Py_buffer source;
+	unsigned int flags = 0;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|I:loads", keywords, &source, &flags)) {
+		return NULL;
+	}
+
+	koml_py_table_t * self = PyObject_New(koml_py_table_t, &koml_py_table_type);
+	koml_table_t * table = malloc(sizeof(koml_table_t));
+	if (self == NULL || table == NULL) {
+		Py_XDECREF(self);
+		free(table);
+		PyBuffer_Release(&source);
+		return (self != NULL) ? PyErr_NoMemory() : NULL;
+	}
+	self->table = NULL;
+	self->holds_source = 0;
+
+	koml_load_options_t options = { .flags = flags & ~KOML_LOAD_CACHE };
+	/* a failed load is validated again for the position of the error */
+	koml_error_t error = { 0 };
+	int ret;
+	Py_BEGIN_ALLOW_THREADS
+	ret = koml_table_load_ex(table, source.buf, source.len, &options);
+	if (ret != 0) {
+		koml_validate(source.buf, source.len, &error);
+	}
+	Py_END_ALLOW_THREADS
+
+	if (ret != 0) {
+		koml_table_destroy(table);
+		free(table);
+		PyBuffer_Release(&source);
+		Py_DECREF(self);
+		return koml_py_raise(ret, &error);
+	}
+
+	self->table = table;
+	if (flags & KOML_LOAD_LAZY) {
+		self->source = source;
+		self->holds_source = 1;
+	} else {
+		PyBuffer_Release(&source);
+	}
+	return (PyObject *) self;
+}
+
+static PyObject * koml_py_load(PyObject * module, PyObject * args, PyObject * kwargs) {
+	(void) module;
+	static char * keywords[] = { "path", "flags", NULL };
+	PyObject * path;
+	unsigned int flags = 0;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O&|I:load", keywords, PyUnicode_FSConverter, &path, &flags)) {
+		return NULL;
+	}
+
+	koml_py_table_t * self = PyObject_New(koml_py_table_t, &koml_py_table_type);
+	koml_table_t * table = malloc(sizeof(koml_table_t));
+	if (self == NULL || table == NULL) {
+		Py_XDECREF(self);
+		free(table);
+		Py_DECREF(path);
+		return (self != NULL) ? PyErr_NoMemory() : NULL;
+	}
+	self->table = NULL;
+	self->holds_source = 0;
+
+	/* load_file owns the buffer it reads, so lazy tables need nothing held here */
+	koml_load_options_t options = { .flags = flags & ~KOML_LOAD_CACHE };
+	int ret;
+	Py_BEGIN_ALLOW_THREADS
+	ret = koml_table_load_file(table, PyBytes_AS_STRING(path), &options);
+	Py_END_ALLOW_THREADS
+	Py_DECREF(path);
+
+	if (ret != 0) {
+		koml_table_destroy(table);
+		free(table);
+		Py_DECREF(self);
+		return koml_py_raise(ret, NULL);
+	}
+
+	self->table = table;
+	return (PyObject *) self;
+}
+
+/* one list per row of shape[depth]; *at walks the row-major elements */
+static PyObject * koml_py_rows(koml_array_t * array, unsigned int depth, unsigned long long int * at) {
+	unsigned long long int count = (array->shape != NULL) ? array->shape[depth] : array->length;
+	unsigned char leaf = (array->shape == NULL || depth + 1 == array->rank);
+	PyObject * list = PyList_New(count);
+	if (list == NULL) {
+		return NULL;
+	}
+
+	for (unsigned long long int i = 0; i < count; ++i) {
+		PyObject * item = (leaf) ? koml_py_element(array, (*at)++) : koml_py_rows(array, depth + 1, at);
+		if (item == NULL) {
+			Py_DECREF(list);
+			return NULL;
+		}
+		PyList_SET_ITEM(list, i, item);
+	}
+
+	return list;
+}
+
+static PyObject * koml_py_key(char * name, unsigned long long int length) {
+	PyObject * key = PyUnicode_DecodeUTF8(name, length, "surrogateescape");
+	if (key != NULL) {
+		PyUnicode_InternInPlace(&key);
+	}
+	return key;
+}
+
+/* the dict of a section, creating missing components; a component that holds a value is replaced, like a later duplicate key in json */
+static PyObject * koml_py_section(PyObject * root, char * section, unsigned long long int length) {
+	PyObject * dict = root;
+
+	for (unsigned long long int at = 0; at < length;) {
+		char * dot = memchr(&section[at], '.', length - at);
+		unsigned long long int end = (dot != NULL) ? (unsigned long long int) (dot - section) : length;
+		PyObject * key = koml_py_key(&section[at], end - at);
+		if (key == NULL) {
+			return NULL;
+		}
+
+		PyObject * child = PyDict_GetItemWithError(dict, key);
+		if (child == NULL && PyErr_Occurred()) {
+			Py_DECREF(key);
+			return NULL;
+		}
+
+		if (child == NULL || !PyDict_CheckExact(child)) {
+			child = PyDict_New();
+			if (child == NULL || PyDict_SetItem(dict, key, child) < 0) {
+				Py_XDECREF(child);
+				Py_DECREF(key);
+				return NULL;
+			}
+			Py_DECREF(child);
+		}
+
+		Py_DECREF(key);
+		dict = child;
+		at = end + 1;
+	}
+
+	return dict;
+}
+
+/*
+ * parses without the gil, then builds the dicts in one walk over the symbols in file order: sections come in runs, so a
+ * section's dict is only looked up when the run changes. keys are interned so tenants with the same keys share them
+ */
+static PyObject * koml_py_loads_dict(PyObject * module, PyObject * args) {
+	(void) module;
+	Py_buffer source;
+	if (!PyArg_ParseTuple(args, "y*:loads_dict", &source)) {
+		return NULL;
+	}
+
+	koml_table_t table;
+	koml_error_t error = { 0 };
+	int ret;
+	Py_BEGIN_ALLOW_THREADS
+	ret = koml_table_load(&table, source.buf, source.len);
+	if (ret != 0) {
+		koml_validate(source.buf, source.len, &error);
+	}
+	Py_END_ALLOW_THREADS
+	PyBuffer_Release(&source);
+
+	if (ret != 0) {
+		koml_table_destroy(&table);
+		return koml_py_raise(ret, &error);
+	}
+
+	PyObject * root = PyDict_New();
+	PyObject * dict = root;
+	char * section = NULL;
+	unsigned long long int section_length = 0;
+
+	for (unsigned long long int i = 0; dict != NULL && i < table.length; ++i) {
+		koml_symbol_t * symbol = &table.symbols[i];
+		char * colon = strchr(symbol->name, ':');
+		unsigned long long int length = (colon != NULL) ? (unsigned long long int) (colon - symbol->name) : 0;
+		if (section == NULL || length != section_length || memcmp(section, symbol->name, length) != 0) {
+			dict = koml_py_section(root, symbol->name, length);
+			section = symbol->name;
+			section_length = length;
+		}
+
+		char * name = (colon != NULL) ? colon + 1 : symbol->name;
+		PyObject * key = (dict != NULL) ? koml_py_key(name, strlen(name)) : NULL;
+		unsigned long long int at = 0;
+		PyObject * value = (key == NULL) ? NULL : (symbol->type == KOML_TYPE_ARRAY) ? koml_py_rows(&symbol->data.array, 0, &at) : koml_py_value(NULL, symbol);
+		if (value == NULL || PyDict_SetItem(dict, key, value) < 0) {
+			dict = NULL;
+		}
+		Py_XDECREF(key);
+		Py_XDECREF(value);
+	}
+
+	koml_table_destroy(&table);
+	if (dict == NULL) {
+		Py_XDECREF(root);
+		return NULL;
+	}
+	return root;
+}
+
+static PyMethodDef koml_py_methods[] = {
+	{ "loads", (PyCFunction) (void (*)(void)) koml_py_loads, METH_VARARGS | METH_KEYWORDS, "loads(data, flags=0) -> Table" },
+	{ "load", (PyCFunction) (void (*)(void)) koml_py_load, METH_VARARGS | METH_KEYWORDS, "load(path, flags=0) -> Table" },
+	{ "loads_dict", (PyCFunction) koml_py_loads_dict, METH_VARARGS, "loads_dict(data) -> dict with a nested dict per section component" },
+	{ NULL, NULL, 0, NULL },
+};
+
+static struct PyModuleDef koml_py_module = {
+	PyModuleDef_HEAD_INIT,
+	.m_name = "_koml",
+	.m_doc = "native KOML bindings",
+	.m_size = -1,
+	.m_methods = koml_py_methods,
+};
+
+PyMODINIT_FUNC PyInit__koml(void) {
+	if (PyType_Ready(&koml_py_table_type) < 0 || PyType_Ready(&koml_py_array_type) < 0) {
+		return NULL;
+	}
+
+	PyObject * module = PyModule_Create(&koml_py_module);
+	if (module == NULL) {
+		return NULL;
+	}
+
+	/* code matches koml_table_load */
+	koml_py_error = PyErr_NewException("_koml.Error", PyExc_ValueError, NULL);
+	if (koml_py_error == NULL
+		|| PyModule_AddObjectRef(module, "Error", koml_py_error) < 0
+		|| PyModule_AddObjectRef(module, "Table", (PyObject *) &koml_py_table_type) < 0
+		|| PyModule_AddObjectRef(module, "Array", (PyObject *) &koml_py_array_type) < 0
+		|| PyModule_AddIntConstant(module, "LOAD_LAZY", KOML_LOAD_LAZY) < 0
+		|| PyModule_AddIntConstant(module, "LOAD_UTF8", KOML_LOAD_UTF8) < 0) {
+		Py_DECREF(module);
+		return NULL;
+	}
+
+	return module;
+}